@@ -320,7 +320,8 @@ final class AdminViewModel: ObservableObject {
           conbustion_possible BOOLEAN NOT NULL DEFAULT 1,
           can_recover_from_conbustion_possible BOOLEAN NOT NULL DEFAULT 0,
           conbustion_temp FLOAT NOT NULL DEFAULT 3000.0,
-          recovery_length_in_hours_from_conbustion INTEGER NOT NULL DEFAULT 72
+          recovery_length_in_hours_from_conbustion INTEGER NOT NULL DEFAULT 72,
+          trigger_timeout_in_seconds FLOAT NOT NULL DEFAULT 0
         );
         """
         _ = runSQLite(dbPath: dbPath, sql: create)
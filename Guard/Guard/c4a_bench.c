@@ -0,0 +1,457 @@
+//
+//  c4a_bench.c
+//  Guard
+//
+//  Micro-benchmarks for the Guard's hot paths. Not installed; build with
+//  `make c4a_bench` and run `./c4a_bench <name>`.
+//
+//    detect   Tick detection cost for 10..5000 command rules against a
+//             synthetic process table, with the shared Aho-Corasick automaton
+//             and with one regex per rule for comparison.
+//    match    Checks that the automaton and one regex per rule detect the
+//             same processes for escaped and anchored command triggers.
+//    model    Cost of catching an idle app up by 1..1000000 cooling steps,
+//             stepping one cycle at a time and in closed form, then checks
+//             that both agree, cooling and heating, for temperatures on and
+//             next to multiples of cool_rate above the floor.
+//    store    Per-pass cost of saving app memories with each store backend
+//             (per-app SQLite, consolidated WAL, journal), through
+//             c4a_load_apps/c4a_save_app_memory, in the tick and with the
+//             write-behind thread (+wb; "drain" is the final flush at
+//             close). Files go to C4A_BENCH_DIR, which is deleted first.
+//    time     Network time sync against a local stand-in server whose clock
+//             runs BENCH_TIME_SKEW seconds ahead (c4a_time_set_sources), and
+//             the restore of the saved offset by a fresh process.
+//
+
+#include "include.h"
+#include "c4a_types.h"
+#include "detection.h"
+#include "c4a_model.h"
+#include "c4a_store.h"
+#include "c4a_time.h"
+#include <sqlite3.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define BENCH_PROCS 600
+#define BENCH_STORE_APPS 200
+#define BENCH_STORE_PASSES 200
+#define BENCH_TIME_SKEW 7200
+
+// guard_main.c is not linked into the bench
+bool file_exists(const char *filename) {
+    return access(filename, F_OK) == 0;
+}
+
+static double bench_now(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+#ifdef __linux__
+static C4aContext *bench_ctx_with_command_rules(size_t n) {
+    C4aContext *ctx = c4a_context_new();
+    if (!ctx) return NULL;
+    ctx->apps = calloc(n, sizeof(C4aApp*));
+    if (!ctx->apps) { c4a_free_context(ctx); return NULL; }
+    for (size_t i = 0; i < n; ++i) {
+        C4aApp *app = calloc(1, sizeof(C4aApp));
+        if (!app) break;
+        char buf[256];
+        snprintf(buf, sizeof(buf), "bench.%zu", i);
+        app->settings.unique_id = strdup(buf);
+        app->settings.trigger_id_type = strdup("command");
+        // Mostly plain paths, with some rules that need regex confirmation.
+        if (i % 10 == 9) {
+            snprintf(buf, sizeof(buf), "/Applications/Game%zu\\.app/Contents/MacOS/.*--profile", i);
+        } else {
+            snprintf(buf, sizeof(buf), "/Applications/App%zu.app/Contents/MacOS/App%zu", i, i);
+        }
+        app->settings.trigger_id_data = strdup(buf);
+        ctx->apps[ctx->app_count++] = app;
+    }
+    return ctx;
+}
+
+static char g_cmdlines[BENCH_PROCS][256];
+static char g_comms[BENCH_PROCS][16];
+static C4aProcInfo g_table[BENCH_PROCS];
+
+static void bench_fill_proc_table(void) {
+    for (int i = 0; i < BENCH_PROCS; ++i) {
+        if (i % 100 == 0) {
+            snprintf(g_cmdlines[i], sizeof(g_cmdlines[i]), "/Applications/App%d.app/Contents/MacOS/App%d --type=renderer", i, i);
+        } else {
+            snprintf(g_cmdlines[i], sizeof(g_cmdlines[i]), "/usr/libexec/service%d --daemon --config /etc/service%d.conf --log-level=info", i, i);
+        }
+        snprintf(g_comms[i], sizeof(g_comms[i]), "service%d", i);
+        g_table[i].pid = (pid_t)(1000 + i);
+        g_table[i].comm = g_comms[i];
+        g_table[i].cmdline = g_cmdlines[i];
+    }
+    c4a_detect_set_proc_table(g_table, BENCH_PROCS);
+}
+
+static double bench_tick_usec(C4aContext *ctx) {
+    c4a_detect_compile(ctx);
+    c4a_detect_all(ctx); // warm up
+    int iters = 0;
+    double t0 = bench_now(), t1 = t0;
+    while (iters < 3 || (t1 - t0) < 0.5) {
+        c4a_detect_all(ctx);
+        iters++;
+        t1 = bench_now();
+    }
+    return (t1 - t0) * 1e6 / iters;
+}
+
+static int bench_detect(void) {
+    const size_t sizes[] = { 10, 100, 1000, 5000 };
+    bench_fill_proc_table();
+    printf("detect: %d processes per tick\n", BENCH_PROCS);
+    printf("%8s %18s %18s\n", "rules", "multipattern us", "regex-per-rule us");
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); ++k) {
+        C4aContext *ctx = bench_ctx_with_command_rules(sizes[k]);
+        if (!ctx) return 1;
+        c4a_detect_set_multipattern(1);
+        double fast = bench_tick_usec(ctx);
+        c4a_detect_set_multipattern(0);
+        double slow = bench_tick_usec(ctx);
+        c4a_detect_set_multipattern(1);
+        printf("%8zu %18.1f %18.1f\n", sizes[k], fast, slow);
+        c4a_free_context(ctx);
+    }
+    c4a_detect_set_proc_table(NULL, 0);
+    return 0;
+}
+// Each pattern with its expected outcome against the cmdlines below.
+static const struct { const char *re; int hits; } g_match_cases[] = {
+    { "\\<steam\\>", 1 },
+    { "steam\\>", 1 },
+    { "\\`/usr/bin/steam", 1 },
+    { "-silent\\'", 1 },
+    { "\\bsteam\\b", 1 },
+    { "\\<team", 0 },
+    { "/opt/Game\\.app/run", 1 },
+    { "/opt/Game\\.app/run\\.x86", 0 },
+    { "a\\+b\\(c\\)", 1 },
+    { "\\$HOME/\\[x\\]", 1 },
+    { "([)]xyz)*b\\(c", 1 },
+    { "<steam>", 0 },
+};
+
+static int bench_match(void) {
+    static const char *cmdlines[] = {
+        "/usr/bin/steam -silent",
+        "/opt/Game.app/run --fullscreen",
+        "/usr/bin/calc a+b(c)",
+        "/bin/sh -c $HOME/[x]",
+    };
+    static char comm[] = "proc";
+    size_t np = sizeof(cmdlines) / sizeof(cmdlines[0]);
+    size_t nc = sizeof(g_match_cases) / sizeof(g_match_cases[0]);
+    C4aProcInfo table[sizeof(cmdlines) / sizeof(cmdlines[0])];
+    for (size_t i = 0; i < np; ++i) {
+        table[i].pid = (pid_t)(2000 + i);
+        table[i].comm = comm;
+        table[i].cmdline = cmdlines[i];
+        table[i].start = 0;
+    }
+    c4a_detect_set_proc_table(table, np);
+    C4aContext *ctx = c4a_context_new();
+    if (!ctx || !(ctx->apps = calloc(nc, sizeof(C4aApp*)))) return 1;
+    for (size_t k = 0; k < nc; ++k) {
+        C4aApp *app = calloc(1, sizeof(C4aApp));
+        if (!app) return 1;
+        char buf[32];
+        snprintf(buf, sizeof(buf), "match.%zu", k);
+        app->settings.unique_id = strdup(buf);
+        app->settings.trigger_id_type = strdup("command");
+        app->settings.trigger_id_data = strdup(g_match_cases[k].re);
+        ctx->apps[ctx->app_count++] = app;
+    }
+    size_t fast[sizeof(g_match_cases) / sizeof(g_match_cases[0])];
+    c4a_detect_set_multipattern(1);
+    c4a_detect_all(ctx);
+    for (size_t k = 0; k < nc; ++k) fast[k] = ctx->apps[k]->pids.len;
+    c4a_detect_set_multipattern(0);
+    c4a_detect_all(ctx);
+    c4a_detect_set_multipattern(1);
+    int bad = 0;
+    printf("%-32s %12s %12s %9s\n", "pattern", "multipattern", "regex", "expected");
+    for (size_t k = 0; k < nc; ++k) {
+        size_t slow = ctx->apps[k]->pids.len;
+        int ok = fast[k] == slow && (slow > 0) == g_match_cases[k].hits;
+        if (!ok) bad++;
+        printf("%-32s %12zu %12zu %9d%s\n", g_match_cases[k].re, fast[k], slow, g_match_cases[k].hits, ok ? "" : "  MISMATCH");
+    }
+    c4a_free_context(ctx);
+    c4a_detect_set_proc_table(NULL, 0);
+    return bad ? 1 : 0;
+}
+#else
+static int bench_match(void) {
+    fprintf(stderr, "match: native detection is Linux-only\n");
+    return 1;
+}
+
+static int bench_detect(void) {
+    fprintf(stderr, "detect: native detection is Linux-only\n");
+    return 1;
+}
+#endif
+
+static void bench_model_app(C4aAppSettings *s, C4aAppMemory *m) {
+    memset(s, 0, sizeof(*s));
+    memset(m, 0, sizeof(*m));
+    s->starting_temperature = 1.0;
+    s->cool_rate = 0.25;
+    m->current_temperature = 5000.0;
+    m->opens_since_last_cooled = 400000;
+}
+
+// Starting temperatures j * cool_rate above the floor (as a product, as a
+// running sum, and a hair either side), where rounding decides the step that
+// lands on the floor; the same starts also heat for up to j + 6 steps.
+static int bench_model_boundary(void) {
+    const double floors[] = { 0.0, 1.0, 20.0 };
+    const double rates[] = { 0.1, 0.25, 0.3, 1.0 / 3.0, 0.7 };
+    int cases = 0, bad = 0;
+    for (size_t f = 0; f < sizeof(floors) / sizeof(floors[0]); ++f) {
+        for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); ++r) {
+            double sum = floors[f];
+            for (int j = 0; j <= 40; ++j, sum += rates[r]) {
+                const double starts[] = { floors[f] + j * rates[r], sum, sum + rates[r] * 1e-12, sum - rates[r] * 1e-12 };
+                for (size_t v = 0; v < sizeof(starts) / sizeof(starts[0]); ++v) {
+                    C4aAppSettings s;
+                    C4aAppMemory a, b;
+                    memset(&s, 0, sizeof(s));
+                    s.starting_temperature = floors[f];
+                    s.cool_rate = rates[r];
+                    s.heat = rates[r];
+                    s.heat_rate = rates[r] / 7;
+                    s.sensitivity = 0.1;
+                    memset(&a, 0, sizeof(a));
+                    a.current_heat = starts[v];
+                    a.current_temperature = starts[v];
+                    a.opens_since_last_cooled = 3;
+                    uint64_t until = c4a_model_steps_until_cooled(&s, &a), cooled_at = 0;
+                    for (uint64_t n = 1; n <= (uint64_t)j + 6; ++n) {
+                        b = a;
+                        c4a_model_advance(&s, &b, 0, n);
+                        C4aAppMemory c = a;
+                        for (uint64_t i = 0; i < n; ++i) c4a_model_advance(&s, &c, 0, 1);
+                        if (c.cooled && !cooled_at) cooled_at = n;
+                        cases++;
+                        if (b.current_temperature != c.current_temperature || b.opens_since_last_cooled != c.opens_since_last_cooled || b.cooled != c.cooled) bad++;
+                        b = a;
+                        c4a_model_advance(&s, &b, 1, n);
+                        c = a;
+                        for (uint64_t i = 0; i < n; ++i) c4a_model_advance(&s, &c, 1, 1);
+                        cases++;
+                        if (b.current_temperature != c.current_temperature || b.current_heat != c.current_heat || b.last_heat != c.last_heat) bad++;
+                    }
+                    if (cooled_at != until) bad++;
+                }
+            }
+        }
+    }
+    printf("model boundary: %d cases, %d mismatches\n", cases, bad);
+    return bad ? 1 : 0;
+}
+
+static int bench_model(void) {
+    const uint64_t steps[] = { 1, 100, 10000, 1000000 };
+    printf("model: idle catch-up from temperature 5000, 400000 opens\n");
+    printf("%10s %14s %14s %12s\n", "steps", "per-step us", "closed us", "max diff");
+    for (size_t k = 0; k < sizeof(steps) / sizeof(steps[0]); ++k) {
+        C4aAppSettings s;
+        C4aAppMemory a, b;
+        bench_model_app(&s, &a);
+        double t0 = bench_now();
+        for (uint64_t i = 0; i < steps[k]; ++i) c4a_model_advance(&s, &a, 0, 1);
+        double t1 = bench_now();
+        int iters = 0;
+        double t2 = bench_now(), t3 = t2;
+        while (iters < 1000 || (t3 - t2) < 0.1) {
+            bench_model_app(&s, &b);
+            c4a_model_advance(&s, &b, 0, steps[k]);
+            iters++;
+            t3 = bench_now();
+        }
+        double diff = fabs(a.current_temperature - b.current_temperature);
+        if (a.opens_since_last_cooled != b.opens_since_last_cooled || a.cooled != b.cooled) diff = INFINITY;
+        printf("%10llu %14.2f %14.3f %12g\n", (unsigned long long)steps[k], (t1 - t0) * 1e6, (t3 - t2) * 1e6 / iters, diff);
+    }
+    return bench_model_boundary();
+}
+
+static int bench_store_settings(void) {
+    mkdir(C4A_BENCH_DIR, 0700);
+    mkdir(APP_SETTINGS_DIR, 0700);
+    sqlite3 *db = NULL;
+    if (sqlite3_open(APP_SETTINGS_DIR "/bench.sqlv", &db) != SQLITE_OK) return -1;
+    int rc = sqlite3_exec(db,
+        "CREATE TABLE app_settings (unique_id,display_name,trigger_id_type,trigger_id_data,"
+        "always_blocked,always_discouraged,sensitivity,starting_temperature,heat_rate,cool_rate,"
+        "seconds_of_usage_before_new_task,temperature_refresh_interval_in_seconds,heat,"
+        "task_maths_available,task_lines_available,task_clicks_available,task_count_available,"
+        "conbustion_possible,can_recover_from_conbustion_possible,conbustion_temp,recovery_length_in_hours_from_conbustion)",
+        NULL, NULL, NULL);
+    sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+    for (int i = 0; rc == SQLITE_OK && i < BENCH_STORE_APPS; ++i) {
+        char sql[256];
+        snprintf(sql, sizeof(sql), "INSERT INTO app_settings VALUES ('bench.%d','Bench %d','name','bench%d',0,0,1,1,1,1,0,60,0,1,1,1,1,0,0,0,0)", i, i, i);
+        rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+    }
+    sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+    sqlite3_close(db);
+    return rc == SQLITE_OK ? 0 : -1;
+}
+
+// One backend, in a child process: the store's handles are process-wide.
+static int bench_store_backend(int backend, int write_behind, const char *name) {
+    if (c4a_store_set_backend(backend) != 0) return 1;
+    C4aContext *ctx = c4a_context_new();
+    if (!ctx) return 1;
+    c4a_load_apps(ctx);
+    if (ctx->app_count == 0) { fprintf(stderr, "store: no apps loaded\n"); return 1; }
+    if (write_behind && c4a_store_start_writer() != 0) return 1;
+    double worst = 0.0, t0 = bench_now();
+    for (int pass = 0; pass < BENCH_STORE_PASSES; ++pass) {
+        double p0 = bench_now();
+        c4a_store_begin(ctx);
+        for (size_t i = 0; i < ctx->app_count; ++i) {
+            C4aApp *app = ctx->apps[i];
+            // A tenth of the apps are running and heat up every pass.
+            if (i % 10 == (size_t)pass % 10 || i % 10 == 0) {
+                app->memory.current_temperature += 0.5;
+                app->memory.opens_since_last_cooled++;
+            }
+            c4a_save_app_memory(ctx, app);
+        }
+        c4a_store_commit(ctx);
+        double dt = bench_now() - p0;
+        if (dt > worst) worst = dt;
+    }
+    double total = bench_now() - t0;
+    double d0 = bench_now();
+    c4a_store_close(ctx);
+    double drain = bench_now() - d0;
+    C4aStoreStats st;
+    c4a_store_stats(&st);
+    printf("%-16s %10.3f %10.3f %9.3f %8llu %8llu %8llu %8llu %8llu\n", name, total * 1e3 / BENCH_STORE_PASSES, worst * 1e3,
+           drain * 1e3, (unsigned long long)st.opens, (unsigned long long)st.steps, (unsigned long long)st.skipped,
+           (unsigned long long)st.appends, (unsigned long long)st.syncs);
+    c4a_free_context(ctx);
+    fflush(stdout);
+    return 0;
+}
+
+static int bench_store(void) {
+    const struct { int backend; int write_behind; const char *name; } backends[] = {
+        { C4A_STORE_PER_APP, 0, "per-app" },
+        { C4A_STORE_CONSOLIDATED, 0, "consolidated" },
+        { C4A_STORE_JOURNAL, 0, "journal" },
+        { C4A_STORE_PER_APP, 1, "per-app+wb" },
+        { C4A_STORE_CONSOLIDATED, 1, "consolidated+wb" },
+        { C4A_STORE_JOURNAL, 1, "journal+wb" },
+    };
+    printf("store: %d apps, %d passes, a fifth of the apps change each pass\n", BENCH_STORE_APPS, BENCH_STORE_PASSES);
+    printf("%-16s %10s %10s %9s %8s %8s %8s %8s %8s\n", "backend", "ms/pass", "worst ms", "drain ms", "opens", "steps", "skipped", "appends", "syncs");
+    for (size_t k = 0; k < sizeof(backends) / sizeof(backends[0]); ++k) {
+        if (system("rm -rf '" C4A_BENCH_DIR "'") != 0 || bench_store_settings() != 0) {
+            fprintf(stderr, "store: cannot set up %s\n", C4A_BENCH_DIR);
+            return 1;
+        }
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) return 1;
+        if (pid == 0) _exit(bench_store_backend(backends[k].backend, backends[k].write_behind, backends[k].name));
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return 1;
+    }
+    return 0;
+}
+
+// Answers every request with a Date header BENCH_TIME_SKEW seconds ahead.
+static void bench_time_serve(int lfd) {
+    for (;;) {
+        int c = accept(lfd, NULL, NULL);
+        if (c < 0) continue;
+        char req[1024], date[64], resp[256];
+        if (read(c, req, sizeof(req)) < 0) { close(c); continue; }
+        time_t t = time(NULL) + BENCH_TIME_SKEW;
+        struct tm tmv;
+        strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", gmtime_r(&t, &tmv));
+        int n = snprintf(resp, sizeof(resp), "HTTP/1.1 200 OK\r\nDate: %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", date);
+        if (write(c, resp, (size_t)n) < 0) { /* client gone */ }
+        close(c);
+    }
+}
+
+// Each step in its own process: the cached offset is process-wide.
+static int bench_time_step(int restore, const char *url) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        double t0 = bench_now();
+        int rc = 0;
+        if (restore) c4a_time_restore();
+        else rc = c4a_time_set_sources(url) == 0 ? c4a_time_sync() : -1;
+        double took = bench_now() - t0;
+        double offset = c4a_trusted_epoch_now() - (double)time(NULL);
+        printf("%-10s %8.1f %12.0f %8s\n", restore ? "restore" : "sync", took * 1e3, offset,
+               rc == 0 && fabs(offset - BENCH_TIME_SKEW) <= 2.0 ? "ok" : "FAIL");
+        fflush(stdout);
+        _exit(rc == 0 && fabs(offset - BENCH_TIME_SKEW) <= 2.0 ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+static int bench_time(void) {
+    if (system("rm -rf '" C4A_BENCH_DIR "'") != 0) return 1;
+    mkdir(C4A_BENCH_DIR, 0700);
+    mkdir(GLOBAL_MEMORIES_DIR, 0700);
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t salen = sizeof(sa);
+    if (lfd < 0 || bind(lfd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(lfd, 8) != 0 ||
+        getsockname(lfd, (struct sockaddr *)&sa, &salen) != 0) {
+        fprintf(stderr, "time: cannot start the stand-in server\n");
+        return 1;
+    }
+    pid_t server = fork();
+    if (server < 0) return 1;
+    if (server == 0) { bench_time_serve(lfd); _exit(0); }
+    close(lfd);
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/", (int)ntohs(sa.sin_port));
+    printf("time: stand-in server at %s, %d s ahead\n", url, BENCH_TIME_SKEW);
+    printf("%-10s %8s %12s %8s\n", "step", "ms", "offset s", "result");
+    int rc = bench_time_step(0, url) == 0 && bench_time_step(1, NULL) == 0 ? 0 : 1;
+    kill(server, SIGKILL);
+    waitpid(server, NULL, 0);
+    return rc;
+}
+
+int main(int argc, char *argv[]) {
+    const char *which = argc > 1 ? argv[1] : "detect";
+    if (strcmp(which, "detect") == 0) return bench_detect();
+    if (strcmp(which, "match") == 0) return bench_match();
+    if (strcmp(which, "model") == 0) return bench_model();
+    if (strcmp(which, "store") == 0) return bench_store();
+    if (strcmp(which, "time") == 0) return bench_time();
+    fprintf(stderr, "usage: %s detect|match|model|store|time\n", argv[0]);
+    return 2;
+}
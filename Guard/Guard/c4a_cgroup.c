@@ -0,0 +1,281 @@
+#include "include.h"
+#include "c4a_cgroup.h"
+#include "detection.h"
+
+#ifdef __linux__
+#include <sys/vfs.h>
+#include <linux/magic.h>
+
+static int g_active = 0;
+
+static int write_str(const char *path, const char *s) {
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    size_t len = strlen(s);
+    ssize_t n = write(fd, s, len);
+    close(fd);
+    return n == (ssize_t)len ? 0 : -1;
+}
+
+// A previous guard that crashed or was killed can leave app groups frozen;
+// nothing else would ever thaw them.
+static void thaw_leftovers(void) {
+    DIR *d = opendir(C4A_CGROUP_ROOT);
+    if (!d) return;
+    struct dirent *ent;
+    int n = 0;
+    while ((ent = readdir(d)) != NULL) {
+        if (strncmp(ent->d_name, "app-", 4) != 0) continue;
+        char path[PATH_MAX];
+        int k = snprintf(path, sizeof(path), "%s/%s/cgroup.freeze", C4A_CGROUP_ROOT, ent->d_name);
+        if (k > 0 && (size_t)k < sizeof(path) && write_str(path, "0") == 0) n++;
+    }
+    closedir(d);
+    if (n > 0) syslog(LOG_INFO, "cgroup: cleared cgroup.freeze of %d existing app groups", n);
+}
+
+// Opened as root (guard_open_privileged): hand the subtree to C4A_USER the
+// way cgroup v2 delegation does, so the guard can still create and manage app
+// groups after change_to_user. Moving processes in is another matter; see
+// place_refused.
+static void delegate_root(void) {
+    struct passwd *pw = getuid() == 0 ? getpwnam(C4A_USER) : NULL;
+    if (!pw) return;
+    static const char *const files[] = { "", "/cgroup.procs", "/cgroup.threads", "/cgroup.subtree_control" };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s%s", C4A_CGROUP_ROOT, files[i]);
+        if (chown(path, pw->pw_uid, pw->pw_gid) != 0 && errno != ENOENT) {
+            syslog(LOG_WARNING, "cgroup: chown %s failed (%d)", path, errno);
+        }
+    }
+}
+
+int c4a_cgroup_open(void) {
+    struct statfs sf;
+    if (access(C4A_CGROUP_ROOT, F_OK) != 0 && mkdir(C4A_CGROUP_ROOT, 0755) != 0) {
+        syslog(LOG_NOTICE, "cgroup root %s unavailable (%d); pid-based enforcement", C4A_CGROUP_ROOT, errno);
+        return -1;
+    }
+    if (statfs(C4A_CGROUP_ROOT, &sf) != 0 || sf.f_type != CGROUP2_SUPER_MAGIC) {
+        syslog(LOG_NOTICE, "%s is not a cgroup2 directory; pid-based enforcement", C4A_CGROUP_ROOT);
+        return -1;
+    }
+    delegate_root();
+    if (access(C4A_CGROUP_ROOT "/cgroup.procs", W_OK) != 0) {
+        syslog(LOG_NOTICE, "cgroup root %s not delegated to the guard; pid-based enforcement", C4A_CGROUP_ROOT);
+        return -1;
+    }
+    thaw_leftovers();
+    g_active = 1;
+    syslog(LOG_NOTICE, "cgroup placement active under %s", C4A_CGROUP_ROOT);
+    return 0;
+}
+
+int c4a_cgroup_active(void) {
+    return g_active;
+}
+
+// Directory names are derived from unique_id; anything outside [A-Za-z0-9._-]
+// becomes '_' so an id can never escape the subtree.
+static void app_dir(const C4aApp *app, char *buf, size_t buflen) {
+    const char *id = app->settings.unique_id ? app->settings.unique_id : "app";
+    int n = snprintf(buf, buflen, "%s/app-", C4A_CGROUP_ROOT);
+    if (n < 0 || (size_t)n >= buflen) { buf[0] = '\0'; return; }
+    size_t k = (size_t)n;
+    for (const char *p = id; *p && k + 1 < buflen; ++p) {
+        unsigned char c = (unsigned char)*p;
+        buf[k++] = (isalnum(c) || c == '.' || c == '_' || c == '-') ? (char)c : '_';
+    }
+    buf[k] = '\0';
+}
+
+int c4a_cgroup_path(const C4aApp *app, char *buf, size_t buflen) {
+    if (!g_active || !app || !app->cgroup) return -1;
+    app_dir(app, buf, buflen);
+    return buf[0] ? 0 : -1;
+}
+
+static int app_file(const C4aApp *app, const char *name, char *buf, size_t buflen) {
+    char dir[PATH_MAX];
+    if (c4a_cgroup_path(app, dir, sizeof(dir)) != 0) return -1;
+    int n = snprintf(buf, buflen, "%s/%s", dir, name);
+    return (n < 0 || (size_t)n >= buflen) ? -1 : 0;
+}
+
+static struct {
+    char *buf;
+    size_t cap;
+} g_io;
+
+// Reads cgroup.procs into out, reusing start times already known in prev.
+static int read_members(const C4aApp *app, const C4aPidSet *prev, C4aPidSet *out) {
+    char path[PATH_MAX];
+    out->len = 0;
+    if (app_file(app, "cgroup.procs", path, sizeof(path)) != 0) return -1;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    size_t len = 0;
+    for (;;) {
+        if (g_io.cap - len < 4096) {
+            size_t ncap = g_io.cap ? g_io.cap * 2 : 16384;
+            char *nb = realloc(g_io.buf, ncap);
+            if (!nb) { close(fd); return -1; }
+            g_io.buf = nb; g_io.cap = ncap;
+        }
+        ssize_t n = read(fd, g_io.buf + len, g_io.cap - len - 1);
+        if (n < 0) { if (errno == EINTR) continue; close(fd); return -1; }
+        if (n == 0) break;
+        len += (size_t)n;
+    }
+    close(fd);
+    g_io.buf[len] = '\0';
+    const C4aProcRef *known = c4a_pidset_citems(prev);
+    for (char *p = g_io.buf; *p; ) {
+        char *end;
+        long v = strtol(p, &end, 10);
+        if (end == p) break;
+        p = end;
+        if (v <= 0) continue;
+        int k = c4a_pidset_find(prev, (pid_t)v);
+        c4a_pidset_push(out, (pid_t)v, k >= 0 ? known[k].start : c4a_proc_start_time((pid_t)v));
+    }
+    return 0;
+}
+
+static int move_pid(const char *procs, pid_t pid) {
+    char b[32];
+    snprintf(b, sizeof(b), "%d\n", (int)pid);
+    return write_str(procs, b);
+}
+
+static C4aPidSet g_members, g_tree;
+static int g_placed;
+
+// Moving a process in needs write access to cgroup.procs of the common
+// ancestor of its current group and ours, which only root has. Refused
+// before anything was ever placed, placement is turned off for good.
+static int place_refused(int err) {
+    if (g_placed || (err != EACCES && err != EPERM)) return 0;
+    syslog(LOG_WARNING, "cgroup: cannot move processes into %s (%d); pid-based enforcement", C4A_CGROUP_ROOT, err);
+    g_active = 0;
+    return 1;
+}
+
+int c4a_cgroup_sync(C4aContext *ctx) {
+    if (!g_active || !ctx) return -1;
+    for (size_t i = 0; i < ctx->app_count && g_active; ++i) {
+        C4aApp *app = ctx->apps[i];
+        if (app->pids.len == 0 && !app->cgroup) continue;
+        char dir[PATH_MAX], procs[PATH_MAX + 16];
+        app_dir(app, dir, sizeof(dir));
+        if (!dir[0]) continue;
+        snprintf(procs, sizeof(procs), "%s/cgroup.procs", dir);
+        if (!app->cgroup && app->pids.len > 0) {
+            if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+                syslog(LOG_WARNING, "cgroup mkdir %s failed (%d)", dir, errno);
+                continue;
+            }
+            app->cgroup = 1;
+        }
+        if (read_members(app, &app->pids, &g_members) != 0) { app->cgroup = 0; continue; }
+        // Place detected processes that are not members yet, with their trees.
+        g_tree.len = 0;
+        const C4aProcRef *it = c4a_pidset_citems(&app->pids);
+        for (int k = 0; k < app->pids.len; ++k) {
+            if (c4a_pidset_find(&g_members, it[k].pid) < 0) c4a_pidset_push(&g_tree, it[k].pid, it[k].start);
+        }
+        int roots = g_tree.len;
+        if (roots > 0) {
+            c4a_proc_descendants(&g_tree, &g_tree);
+            const C4aProcRef *t = c4a_pidset_citems(&g_tree);
+            int moved = 0;
+            for (int k = 0; k < g_tree.len; ++k) {
+                if (!c4a_proc_is(t[k].pid, t[k].start)) continue;
+                if (move_pid(procs, t[k].pid) == 0) { moved++; g_placed = 1; }
+                else if (place_refused(errno)) break;
+            }
+            if (moved > 0) {
+                syslog(LOG_INFO, "cgroup: placed %d processes (%d detected) of %s", moved, roots, app->settings.unique_id ?: "");
+            }
+            read_members(app, &app->pids, &g_members);
+        }
+        // Members are the process list, helpers included, plus any detected
+        // process that could not be placed.
+        app->pids.len = 0;
+        const C4aProcRef *m = c4a_pidset_citems(&g_members);
+        for (int k = 0; k < g_members.len; ++k) c4a_pidset_push(&app->pids, m[k].pid, m[k].start);
+        const C4aProcRef *t = c4a_pidset_citems(&g_tree);
+        app->cgroup_strays = 0;
+        for (int k = 0; k < roots; ++k) {
+            if (c4a_pidset_find(&g_members, t[k].pid) < 0 && c4a_proc_is(t[k].pid, t[k].start)) {
+                c4a_pidset_push(&app->pids, t[k].pid, t[k].start);
+                app->cgroup_strays++;
+            }
+        }
+        app->is_running = (app->pids.len > 0);
+        if (app->pids.len == 0 && !app->cgroup_frozen && rmdir(dir) == 0) app->cgroup = 0;
+    }
+    if (!g_active) {
+        // Nothing was ever placed: drop the empty groups made on the way.
+        for (size_t i = 0; i < ctx->app_count; ++i) {
+            C4aApp *app = ctx->apps[i];
+            if (!app->cgroup) continue;
+            char dir[PATH_MAX];
+            app_dir(app, dir, sizeof(dir));
+            if (dir[0]) rmdir(dir);
+            app->cgroup = 0;
+            app->cgroup_strays = 0;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+int c4a_cgroup_kill(const C4aApp *app) {
+    char path[PATH_MAX];
+    if (app_file(app, "cgroup.kill", path, sizeof(path)) != 0) return -1;
+    return write_str(path, "1");
+}
+
+// cgroup.freeze of every group this guard froze, kept open so a fatal
+// signal handler can thaw them without building paths.
+static struct { const C4aApp *app; int fd; } g_frozen[C4A_CGROUP_MAX_FROZEN];
+
+static int frozen_slot(const C4aApp *app) {
+    for (int k = 0; k < C4A_CGROUP_MAX_FROZEN; ++k) if (g_frozen[k].app == app) return k;
+    return -1;
+}
+
+int c4a_cgroup_freeze(C4aApp *app, int frozen) {
+    char path[PATH_MAX];
+    if (app_file(app, "cgroup.freeze", path, sizeof(path)) != 0) return -1;
+    int k = frozen_slot(app);
+    if (frozen && k < 0 && (k = frozen_slot(NULL)) >= 0) {
+        int fd = open(path, O_WRONLY | O_CLOEXEC);
+        if (fd >= 0) { g_frozen[k].fd = fd; g_frozen[k].app = app; } else k = -1;
+    }
+    int rc = write_str(path, frozen ? "1" : "0");
+    if (k >= 0 && (!frozen || (rc != 0 && !app->cgroup_frozen))) { close(g_frozen[k].fd); g_frozen[k].app = NULL; }
+    if (rc != 0) return -1;
+    app->cgroup_frozen = frozen ? 1 : 0;
+    return 0;
+}
+
+void c4a_cgroup_release_all(void) {
+    for (int k = 0; k < C4A_CGROUP_MAX_FROZEN; ++k) {
+        if (g_frozen[k].app) (void)!write(g_frozen[k].fd, "0", 1);
+    }
+}
+
+#else
+
+int c4a_cgroup_open(void) { return -1; }
+int c4a_cgroup_active(void) { return 0; }
+int c4a_cgroup_sync(C4aContext *ctx) { (void)ctx; return -1; }
+int c4a_cgroup_path(const C4aApp *app, char *buf, size_t buflen) { (void)app; (void)buf; (void)buflen; return -1; }
+int c4a_cgroup_kill(const C4aApp *app) { (void)app; return -1; }
+int c4a_cgroup_freeze(C4aApp *app, int frozen) { (void)app; (void)frozen; return -1; }
+void c4a_cgroup_release_all(void) {}
+
+#endif
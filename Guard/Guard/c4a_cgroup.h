@@ -0,0 +1,36 @@
+#ifndef C4A_CGROUP_H
+#define C4A_CGROUP_H
+
+#include "c4a_types.h"
+
+// cgroup v2 placement (Linux). Each detected app's process tree is moved into
+// C4A_CGROUP_ROOT/<app>, a delegated subtree the Guard can write. From then on
+// children land there by inheritance whatever their cmdline, "is running" is
+// one read of cgroup.procs, and blocking or freezing the whole tree is one
+// write to cgroup.kill or cgroup.freeze. Without a usable subtree every call
+// fails and the pid-based paths stay in charge.
+//
+// Moving a process in from outside the subtree needs root: cgroup v2 checks
+// write access to cgroup.procs of the common ancestor, which delegation does
+// not give. A guard that dropped to C4A_USER has its first move refused and
+// turns placement off.
+
+// Checks that C4A_CGROUP_ROOT is a writable cgroup2 directory (creating it if
+// needed) and thaws app groups a previous guard left frozen. Returns 0 when
+// placement is active.
+int c4a_cgroup_open(void);
+int c4a_cgroup_active(void);
+// Moves each app's detected pids (and their descendants) into its cgroup, then
+// replaces app->pids with the cgroup's members plus the detected pids that
+// could not be placed, and updates is_running.
+int c4a_cgroup_sync(C4aContext *ctx);
+// Path of the app's cgroup directory. Returns 0 when the app has one.
+int c4a_cgroup_path(const C4aApp *app, char *buf, size_t buflen);
+// Writes 1 to cgroup.kill: SIGKILL for every member at once.
+int c4a_cgroup_kill(const C4aApp *app);
+// Writes cgroup.freeze. Returns 0 once the request was accepted.
+int c4a_cgroup_freeze(C4aApp *app, int frozen);
+// Thaws every group this guard froze. Async-signal-safe (fatal-signal path).
+void c4a_cgroup_release_all(void);
+
+#endif
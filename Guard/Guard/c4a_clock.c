@@ -0,0 +1,45 @@
+#include "include.h"
+#include "c4a_clock.h"
+#include "c4a_time.h"
+
+static double real_mono(C4aClock *c) { (void)c; return c4a_mono_now(); }
+static double real_epoch(C4aClock *c) { (void)c; return c4a_trusted_epoch_now(); }
+static double real_wall(C4aClock *c) { (void)c; return (double)time(NULL); }
+
+static C4aClock g_real = { real_mono, real_epoch, real_wall };
+
+C4aClock *c4a_clock_real(void) {
+    return &g_real;
+}
+
+static double virtual_mono(C4aClock *c) { return ((C4aVirtualClock *)c)->mono; }
+static double virtual_epoch(C4aClock *c) { return ((C4aVirtualClock *)c)->epoch; }
+
+void c4a_clock_virtual_init(C4aVirtualClock *vc, double mono, double epoch) {
+    vc->base.mono = virtual_mono;
+    vc->base.epoch = virtual_epoch;
+    vc->base.wall = virtual_epoch;
+    vc->mono = mono;
+    vc->epoch = epoch;
+}
+
+void c4a_clock_virtual_advance(C4aVirtualClock *vc, double seconds) {
+    if (seconds <= 0) return;
+    vc->mono += seconds;
+    vc->epoch += seconds;
+}
+
+double c4a_clock_mono(const C4aContext *ctx) {
+    C4aClock *c = ctx && ctx->clock ? ctx->clock : &g_real;
+    return c->mono(c);
+}
+
+double c4a_clock_epoch(const C4aContext *ctx) {
+    C4aClock *c = ctx && ctx->clock ? ctx->clock : &g_real;
+    return c->epoch(c);
+}
+
+double c4a_clock_wall(const C4aContext *ctx) {
+    C4aClock *c = ctx && ctx->clock ? ctx->clock : &g_real;
+    return c->wall(c);
+}
@@ -0,0 +1,34 @@
+#ifndef C4A_CLOCK_H
+#define C4A_CLOCK_H
+
+#include "c4a_types.h"
+
+// Time source for the guard's decisions, injected through ctx->clock. The
+// real clock reads c4a_mono_now(), c4a_trusted_epoch_now() and time(); a
+// virtual clock only moves when told to, so a harness can drive guard_tick()
+// through days of simulated time in a moment. Durations measured for metrics
+// and process handling (kill grace, probe timeouts) stay on the real clock.
+struct C4aClock {
+    double (*mono)(C4aClock *c);   // monotonic seconds
+    double (*epoch)(C4aClock *c);  // trusted seconds since the epoch
+    double (*wall)(C4aClock *c);   // system seconds since the epoch, for timestamps
+};
+
+typedef struct {
+    C4aClock base;
+    double mono;
+    double epoch;
+} C4aVirtualClock;
+
+C4aClock *c4a_clock_real(void);
+// Starts a virtual clock at the given monotonic and epoch readings; its wall
+// time is its epoch.
+void c4a_clock_virtual_init(C4aVirtualClock *vc, double mono, double epoch);
+void c4a_clock_virtual_advance(C4aVirtualClock *vc, double seconds);
+
+// Readings for ctx, on the real clock when ctx->clock is NULL.
+double c4a_clock_mono(const C4aContext *ctx);
+double c4a_clock_epoch(const C4aContext *ctx);
+double c4a_clock_wall(const C4aContext *ctx);
+
+#endif
@@ -0,0 +1,154 @@
+#include "include.h"
+#include <poll.h>
+#include <libgen.h>
+#include "c4a_exit.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+
+// Per thread: main.c's launcher threads and the guard loop each drain their
+// own watch, so no event is consumed on one thread and missed on another.
+static __thread int g_fd = -1;
+static __thread pid_t g_owner = 0;   // process the watch belongs to; a forked child opens its own
+static __thread int g_failed = 0;
+static __thread int g_present = 0;
+static __thread int g_requests = 0;  // request database touched since last taken
+
+static int token_present(void) {
+    return access(AUTHORIZED_TO_EXIT_FILE, F_OK) == 0;
+}
+
+static const char *token_name(void) {
+    const char *slash = strrchr(AUTHORIZED_TO_EXIT_FILE, '/');
+    return slash ? slash + 1 : AUTHORIZED_TO_EXIT_FILE;
+}
+
+static const char *requests_name(void) {
+    const char *slash = strrchr(REQUESTS_DB_PATH, '/');
+    return slash ? slash + 1 : REQUESTS_DB_PATH;
+}
+
+// The request database (with its -journal/-wal) is seen by the same watch
+// when it lives next to the token.
+static int requests_in_dir(void) {
+    size_t td = strlen(AUTHORIZED_TO_EXIT_FILE) - strlen(token_name());
+    size_t rd = strlen(REQUESTS_DB_PATH) - strlen(requests_name());
+    return td == rd && strncmp(AUTHORIZED_TO_EXIT_FILE, REQUESTS_DB_PATH, td) == 0;
+}
+
+static void watch_close(void) {
+    if (g_fd >= 0 && g_owner == getpid()) close(g_fd);
+    g_fd = -1;
+}
+
+static int watch_open(void) {
+    if (g_fd >= 0 && g_owner == getpid()) return 0;
+    // Inherited across fork: the parent keeps its own copy.
+    if (g_fd >= 0) close(g_fd);
+    g_fd = -1;
+    g_owner = getpid();
+    if (g_failed) return -1;
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", AUTHORIZED_TO_EXIT_FILE);
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, dirname(dir), IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF | IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+        syslog(LOG_NOTICE, "exit token watch unavailable (%d); polling", errno);
+        if (fd >= 0) close(fd);
+        g_failed = 1;
+        return -1;
+    }
+    g_fd = fd;
+    // Armed before the first look, so a token created in between is not lost.
+    g_present = token_present();
+    return 0;
+}
+
+// Applies pending events. A lost event (queue overflow) or a lost directory
+// falls back to one real check; the directory loss also drops the watch.
+static void watch_drain(void) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const char *name = token_name();
+    const char *req = requests_name();
+    size_t req_len = strlen(req);
+    int recheck = 0, lost = 0;
+    for (;;) {
+        ssize_t n = read(g_fd, buf, sizeof(buf));
+        if (n <= 0) break;
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            if (ev->mask & IN_Q_OVERFLOW) recheck = 1;
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) lost = 1;
+            if (ev->len > 0 && strcmp(ev->name, name) == 0) {
+                if (ev->mask & (IN_CREATE | IN_MOVED_TO)) g_present = 1;
+                if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) g_present = 0;
+            } else if (ev->len > 0 && strncmp(ev->name, req, req_len) == 0) {
+                g_requests = 1;
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    if (lost) {
+        watch_close();
+        g_failed = 1;
+        syslog(LOG_NOTICE, "exit token directory went away; polling");
+    }
+    if (recheck) { g_present = token_present(); g_requests = 1; }
+}
+
+int c4a_exit_requested(void) {
+    if (watch_open() != 0) return token_present();
+    watch_drain();
+    if (g_fd < 0) return token_present();
+    return g_present;
+}
+
+int c4a_exit_fd(void) {
+    if (watch_open() != 0) return -1;
+    return g_fd;
+}
+
+int c4a_exit_watches_requests(void) {
+    return c4a_exit_fd() >= 0 && requests_in_dir();
+}
+
+int c4a_exit_requests_changed(void) {
+    if (!c4a_exit_watches_requests()) return 0;
+    watch_drain();
+    int changed = g_requests;
+    g_requests = 0;
+    return changed;
+}
+#else
+int c4a_exit_requested(void) {
+    return access(AUTHORIZED_TO_EXIT_FILE, F_OK) == 0;
+}
+
+int c4a_exit_fd(void) {
+    return -1;
+}
+
+int c4a_exit_watches_requests(void) {
+    return 0;
+}
+
+int c4a_exit_requests_changed(void) {
+    return 0;
+}
+#endif
+
+int c4a_exit_wait(double seconds) {
+    if (c4a_exit_requested()) return 1;
+    int fd = c4a_exit_fd();
+    if (fd < 0) {
+        if (seconds > 0) {
+            struct timespec ts = { (time_t)seconds, (long)((seconds - (double)(time_t)seconds) * 1e9) };
+            nanosleep(&ts, NULL);
+        }
+        return c4a_exit_requested();
+    }
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    if (poll(&pfd, 1, seconds > 0 ? (int)(seconds * 1000.0) : 0) < 0 && errno != EINTR) {
+        syslog(LOG_NOTICE, "exit token wait failed (%d)", errno);
+    }
+    return c4a_exit_requested();
+}
@@ -0,0 +1,24 @@
+#ifndef C4A_EXIT_H
+#define C4A_EXIT_H
+
+// Watches for the exit token (AUTHORIZED_TO_EXIT_FILE). On Linux an inotify
+// watch on its directory (one per thread and process) keeps a cached flag up
+// to date, so checking costs no stat and a waiting loop can wake the moment
+// the token appears. Elsewhere, or
+// when the directory cannot be watched, every check falls back to access().
+
+// Whether the exit token is present.
+int c4a_exit_requested(void);
+// Readable descriptor that signals token changes, or -1 when not watching.
+int c4a_exit_fd(void);
+// 1 when the watch also sees REQUESTS_DB_PATH, i.e. it shares the token's
+// directory; a waiting loop then wakes on new requests through c4a_exit_fd.
+int c4a_exit_watches_requests(void);
+// Whether the request database's files were written since the last call (0
+// when it is not watched). The guard's own request pass counts too;
+// c4a_requests_pending tells whether anything is actually queued.
+int c4a_exit_requests_changed(void);
+// Sleeps up to seconds or until the token appears. Returns c4a_exit_requested().
+int c4a_exit_wait(double seconds);
+
+#endif
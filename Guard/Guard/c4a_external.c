@@ -0,0 +1,391 @@
+#include "include.h"
+#include <strings.h>
+#include <poll.h>
+#include <spawn.h>
+#include "c4a_external.h"
+#include "c4a_time.h"
+#include "detection.h"
+
+extern char **environ;
+
+enum { EXT_IDLE, EXT_QUEUED, EXT_RUNNING, EXT_DONE };
+
+typedef struct {
+    char *unique_id;    // private copies: workers never touch ctx
+    char *mode;         // NULL when the app is not handled here
+    char *data;
+    int state;
+    int ok;             // last run completed within its deadline
+    C4aPidSet result;   // written by the worker while RUNNING
+    C4aPidSet cached;   // latest good result, read by the tick
+    double started_at;
+    double fetched_at;  // 0 = never ran
+    double timeout;
+    unsigned round;     // refresh call that queued the current run
+    int orphan;         // dropped from the table while RUNNING; the worker frees it
+    uint64_t runs, timeouts, failures;
+    double last_ms, total_ms, max_ms;
+} C4aExtRule;
+
+static struct {
+    pthread_mutex_t mu;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    const C4aContext *ctx;
+    size_t app_count;
+    int native_ok;
+    C4aExtRule **rules;  // indexed like ctx->apps
+    size_t n;
+    size_t *queue;       // ring of rule indexes, each queued at most once
+    size_t qhead, qlen;
+    int nworkers;
+    unsigned round;
+} g_ext = { .mu = PTHREAD_MUTEX_INITIALIZER, .work = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER };
+
+// Serialises pipe creation with spawning so a sibling worker's child never
+// inherits another probe's write end (which would delay that probe's EOF).
+static pthread_mutex_t g_spawn_mu = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *ext_mode_for(const C4aApp *app, int native_ok) {
+    const char *type = app->settings.trigger_id_type;
+    if (!type) return NULL;
+    if (strcasecmp(type, "external") == 0) return "external";
+    if (native_ok) return NULL;
+    if (strcasecmp(type, "name") == 0) return "name";
+    if (strcasecmp(type, "command") == 0) return "command";
+    return NULL;
+}
+
+static void ext_parse_line(const char *line, C4aPidSet *out) {
+    char *end = NULL;
+    long v = strtol(line, &end, 10);
+    if (end == line || v <= 0) return;
+    c4a_pidset_push(out, (pid_t)v, c4a_proc_start_time((pid_t)v));
+}
+
+// Runs one probe. Returns 0 when it finished in time, 1 on timeout, -1 on error.
+static int ext_run(const char *mode, const char *data, double timeout, C4aPidSet *out) {
+    out->len = 0;
+    char spath[PATH_MAX] = {0};
+    if (c4a_pcheck_path(spath, sizeof(spath)) != 0) return -1;
+    char *argv[] = { spath, (char *)mode, (char *)(data ? data : ""), NULL };
+    int fds[2];
+    pid_t pid = -1;
+    pthread_mutex_lock(&g_spawn_mu);
+    if (pipe(fds) != 0) { pthread_mutex_unlock(&g_spawn_mu); return -1; }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t at;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_adddup2(&fa, fds[1], STDOUT_FILENO);
+    posix_spawnattr_init(&at);
+    // Own process group, so a timeout takes the whole pipeline down.
+    posix_spawnattr_setflags(&at, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&at, 0);
+    int rc = posix_spawn(&pid, spath, &fa, &at, argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&at);
+    close(fds[1]);
+    pthread_mutex_unlock(&g_spawn_mu);
+    if (rc != 0) { close(fds[0]); return -1; }
+
+    double deadline = c4a_mono_now() + timeout;
+    int timed_out = 0;
+    char buf[8192];
+    size_t blen = 0;
+    for (;;) {
+        int ms = (int)((deadline - c4a_mono_now()) * 1000.0);
+        if (ms <= 0) { timed_out = 1; break; }
+        struct pollfd pfd = { fds[0], POLLIN, 0 };
+        int pr = poll(&pfd, 1, ms);
+        if (pr < 0 && errno != EINTR) break;
+        if (pr <= 0) continue;
+        ssize_t n = read(fds[0], buf + blen, sizeof(buf) - 1 - blen);
+        if (n < 0) { if (errno == EINTR) continue; break; }
+        if (n == 0) break;
+        blen += (size_t)n;
+        buf[blen] = '\0';
+        char *line = buf, *nl;
+        while ((nl = strchr(line, '\n')) != NULL) {
+            *nl = '\0';
+            ext_parse_line(line, out);
+            line = nl + 1;
+        }
+        blen -= (size_t)(line - buf);
+        memmove(buf, line, blen);
+        if (blen == sizeof(buf) - 1) blen = 0; // overlong line; drop it
+    }
+    if (!timed_out && blen > 0) { buf[blen] = '\0'; ext_parse_line(buf, out); }
+    close(fds[0]);
+
+    if (timed_out) kill(-pid, SIGKILL);
+    int st;
+    for (;;) {
+        pid_t w = waitpid(pid, &st, timed_out ? 0 : WNOHANG);
+        if (w == pid || (w < 0 && errno != EINTR)) break;
+        if (w != 0) continue;
+        if (c4a_mono_now() >= deadline) {
+            // Output closed but the script is still alive.
+            timed_out = 1;
+            kill(-pid, SIGKILL);
+        } else {
+            struct timespec ts = { 0, 10 * 1000 * 1000 };
+            nanosleep(&ts, NULL);
+        }
+    }
+    return timed_out ? 1 : 0;
+}
+
+static void ext_free_rule(C4aExtRule *r) {
+    free(r->unique_id); free(r->mode); free(r->data);
+    c4a_pidset_free(&r->result);
+    c4a_pidset_free(&r->cached);
+    free(r);
+}
+
+// Takes one queued rule and runs it. Called and returns with the lock held.
+static void ext_run_next(void) {
+    size_t i = g_ext.queue[g_ext.qhead];
+    g_ext.qhead = (g_ext.qhead + 1) % g_ext.n;
+    g_ext.qlen--;
+    C4aExtRule *r = g_ext.rules[i];
+    r->state = EXT_RUNNING;
+    // A rebuild of the table orphans a running rule instead of freeing it, so
+    // r and its strings stay valid without the lock.
+    pthread_mutex_unlock(&g_ext.mu);
+    double t0 = c4a_mono_now();
+    int rc = ext_run(r->mode, r->data, r->timeout, &r->result);
+    double ms = (c4a_mono_now() - t0) * 1000.0;
+    pthread_mutex_lock(&g_ext.mu);
+    if (r->orphan) { ext_free_rule(r); return; }
+    r->runs++;
+    r->last_ms = ms;
+    r->total_ms += ms;
+    if (ms > r->max_ms) r->max_ms = ms;
+    if (rc == 1) {
+        r->timeouts++;
+        syslog(LOG_WARNING, "trigger probe for %s exceeded %.1fs; killed", r->unique_id ? r->unique_id : "?", r->timeout);
+    } else if (rc < 0) {
+        r->failures++;
+    }
+    r->ok = (rc == 0);
+    r->started_at = t0;
+    r->state = EXT_DONE;
+    pthread_cond_broadcast(&g_ext.done);
+}
+
+static void *ext_worker(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_ext.mu);
+    for (;;) {
+        while (g_ext.qlen == 0) pthread_cond_wait(&g_ext.work, &g_ext.mu);
+        ext_run_next();
+    }
+    return NULL;
+}
+
+// Publishes finished runs. A timed-out or failed run keeps the previous
+// result (kills re-check start times, so stale pids are harmless) but still
+// counts as fresh so it is not retried before the TTL.
+static void ext_collect(void) {
+    for (size_t i = 0; i < g_ext.n; ++i) {
+        C4aExtRule *r = g_ext.rules[i];
+        if (r->state != EXT_DONE) continue;
+        if (r->ok) {
+            C4aPidSet tmp = r->cached;
+            r->cached = r->result;
+            r->result = tmp;
+        }
+        r->fetched_at = r->started_at;
+        r->state = EXT_IDLE;
+    }
+}
+
+static void ext_free_rules(void) {
+    for (size_t i = 0; i < g_ext.n; ++i) {
+        C4aExtRule *r = g_ext.rules[i];
+        if (r->state == EXT_RUNNING) r->orphan = 1;
+        else ext_free_rule(r);
+    }
+    free(g_ext.rules);
+    free(g_ext.queue);
+    g_ext.rules = NULL; g_ext.queue = NULL;
+    g_ext.n = 0; g_ext.qhead = 0; g_ext.qlen = 0;
+}
+
+static int str_eq(const char *a, const char *b) {
+    return a && b ? strcmp(a, b) == 0 : a == b;
+}
+
+// The same probe in the table being replaced, once it has a result.
+static const C4aExtRule *ext_previous(C4aExtRule **old, size_t n, const C4aExtRule *r) {
+    for (size_t i = 0; i < n; ++i) {
+        const C4aExtRule *o = old[i];
+        if (o->mode && o->fetched_at > 0 && str_eq(o->unique_id, r->unique_id) && str_eq(o->mode, r->mode) && str_eq(o->data, r->data)) return o;
+    }
+    return NULL;
+}
+
+// Rebuilds the rule table when ctx's apps changed. Nothing waits for probes
+// still running: they finish as orphans, and each rule starts from the last
+// result of the same probe. Called with the lock held.
+static int ext_prepare(const C4aContext *ctx, int native_ok) {
+    if (g_ext.rules && g_ext.ctx == ctx && g_ext.app_count == ctx->app_count && g_ext.native_ok == native_ok) return 0;
+    C4aExtRule **rules = ctx->app_count ? calloc(ctx->app_count, sizeof(C4aExtRule *)) : NULL;
+    size_t *queue = ctx->app_count ? calloc(ctx->app_count, sizeof(size_t)) : NULL;
+    for (size_t i = 0; rules && i < ctx->app_count; ++i) {
+        if (!(rules[i] = calloc(1, sizeof(C4aExtRule)))) { for (size_t k = 0; k < i; ++k) free(rules[k]); free(rules); rules = NULL; }
+    }
+    if (ctx->app_count && (!rules || !queue)) { free(rules); free(queue); return -1; }
+    for (size_t i = 0; i < ctx->app_count; ++i) {
+        const C4aApp *app = ctx->apps[i];
+        const char *mode = ext_mode_for(app, native_ok);
+        if (!mode) continue;
+        C4aExtRule *r = rules[i];
+        r->mode = strdup(mode);
+        r->data = strdup(app->settings.trigger_id_data ? app->settings.trigger_id_data : "");
+        r->unique_id = app->settings.unique_id ? strdup(app->settings.unique_id) : NULL;
+        if (!r->mode || !r->data) { free(r->mode); free(r->data); r->mode = NULL; r->data = NULL; continue; }
+        const C4aExtRule *o = ext_previous(g_ext.rules, g_ext.n, r);
+        if (o) {
+            const C4aProcRef *it = c4a_pidset_citems(&o->cached);
+            for (int k = 0; k < o->cached.len; ++k) c4a_pidset_push(&r->cached, it[k].pid, it[k].start);
+            r->fetched_at = o->fetched_at;
+            r->runs = o->runs; r->timeouts = o->timeouts; r->failures = o->failures;
+            r->last_ms = o->last_ms; r->total_ms = o->total_ms; r->max_ms = o->max_ms;
+        }
+    }
+    ext_free_rules();
+    g_ext.rules = rules;
+    g_ext.queue = queue;
+    g_ext.n = ctx->app_count;
+    g_ext.ctx = ctx;
+    g_ext.app_count = ctx->app_count;
+    g_ext.native_ok = native_ok;
+    return 0;
+}
+
+static double ext_timeout_for(const C4aApp *app) {
+    return app->settings.trigger_timeout_in_seconds > 0 ? app->settings.trigger_timeout_in_seconds : C4A_EXTERNAL_TIMEOUT_SECONDS;
+}
+
+// Whether a probe queued by this call has no result to fall back on yet.
+static int ext_round_pending(unsigned round) {
+    for (size_t i = 0; i < g_ext.n; ++i) {
+        const C4aExtRule *r = g_ext.rules[i];
+        if (r->round == round && r->fetched_at <= 0 && (r->state == EXT_QUEUED || r->state == EXT_RUNNING)) return 1;
+    }
+    return 0;
+}
+
+static void ext_start_workers(void) {
+    int want = C4A_EXTERNAL_WORKERS < 1 ? 1 : C4A_EXTERNAL_WORKERS;
+    while (g_ext.nworkers < want) {
+        pthread_t th;
+        if (pthread_create(&th, NULL, ext_worker, NULL) != 0) break;
+        pthread_detach(th);
+        g_ext.nworkers++;
+    }
+}
+
+int c4a_external_refresh(C4aContext *ctx, int native_ok) {
+    if (!ctx) return -1;
+    pthread_mutex_lock(&g_ext.mu);
+    if (ext_prepare(ctx, native_ok) != 0) { pthread_mutex_unlock(&g_ext.mu); return -1; }
+    ext_collect();
+    double now = c4a_mono_now();
+    unsigned round = ++g_ext.round;
+    int started = 0;
+    for (size_t i = 0; i < g_ext.n; ++i) {
+        C4aExtRule *r = g_ext.rules[i];
+        if (!r->mode || r->state != EXT_IDLE) continue;
+        if (r->fetched_at > 0 && (now - r->fetched_at) < C4A_EXTERNAL_TTL_SECONDS) continue;
+        r->state = EXT_QUEUED;
+        r->round = round;
+        r->timeout = ext_timeout_for(ctx->apps[i]);
+        g_ext.queue[(g_ext.qhead + g_ext.qlen) % g_ext.n] = i;
+        g_ext.qlen++;
+        started++;
+    }
+    if (started) {
+        ext_start_workers();
+        if (g_ext.nworkers == 0) {
+            // No threads available: fall back to running the probes inline.
+            while (g_ext.qlen > 0) ext_run_next();
+        }
+        pthread_cond_broadcast(&g_ext.work);
+    }
+    // Only probes that never produced a result are waited for, and only for
+    // this call's runs; everything else is read from the cache and picked up
+    // by a later call.
+    if (started && g_ext.nworkers > 0) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        long ns = until.tv_nsec + (long)(C4A_EXTERNAL_JOIN_MS % 1000) * 1000000L;
+        until.tv_sec += C4A_EXTERNAL_JOIN_MS / 1000 + ns / 1000000000L;
+        until.tv_nsec = ns % 1000000000L;
+        while (ext_round_pending(round)) {
+            if (pthread_cond_timedwait(&g_ext.done, &g_ext.mu, &until) == ETIMEDOUT) break;
+        }
+    }
+    ext_collect();
+    pthread_mutex_unlock(&g_ext.mu);
+    return 0;
+}
+
+int c4a_external_result(const C4aContext *ctx, size_t i, C4aPidSet *out) {
+    int handled = 0;
+    pthread_mutex_lock(&g_ext.mu);
+    if (g_ext.ctx == ctx && i < g_ext.n && g_ext.rules[i]->mode) {
+        const C4aPidSet *src = &g_ext.rules[i]->cached;
+        const C4aProcRef *items = c4a_pidset_citems(src);
+        out->len = 0;
+        for (int k = 0; k < src->len; ++k) c4a_pidset_push(out, items[k].pid, items[k].start);
+        handled = 1;
+    }
+    pthread_mutex_unlock(&g_ext.mu);
+    return handled;
+}
+
+size_t c4a_external_stats(C4aExternalStat *out, size_t max) {
+    size_t count = 0;
+    pthread_mutex_lock(&g_ext.mu);
+    for (size_t i = 0; i < g_ext.n; ++i) {
+        const C4aExtRule *r = g_ext.rules[i];
+        if (!r->mode) continue;
+        if (out && count < max) {
+            C4aExternalStat *s = &out[count];
+            snprintf(s->unique_id, sizeof(s->unique_id), "%s", r->unique_id ? r->unique_id : "?");
+            s->runs = r->runs;
+            s->timeouts = r->timeouts;
+            s->failures = r->failures;
+            s->last_ms = r->last_ms;
+            s->avg_ms = r->runs ? r->total_ms / (double)r->runs : 0.0;
+            s->max_ms = r->max_ms;
+        }
+        count++;
+    }
+    pthread_mutex_unlock(&g_ext.mu);
+    return count;
+}
+
+void c4a_external_log_stats(void) {
+    size_t n = c4a_external_stats(NULL, 0);
+    if (n == 0) return;
+    C4aExternalStat *st = calloc(n, sizeof(C4aExternalStat));
+    if (!st) return;
+    n = c4a_external_stats(st, n);
+    // Report the five slowest rules by worst case.
+    for (int k = 0; k < 5 && (size_t)k < n; ++k) {
+        size_t best = (size_t)k;
+        for (size_t j = (size_t)k + 1; j < n; ++j) {
+            if (st[j].max_ms > st[best].max_ms) best = j;
+        }
+        C4aExternalStat tmp = st[k]; st[k] = st[best]; st[best] = tmp;
+        if (st[k].runs == 0) break;
+        syslog(LOG_INFO, "trigger probe %s: runs=%" PRIu64 " avg=%.1fms max=%.1fms last=%.1fms timeouts=%" PRIu64 " failures=%" PRIu64,
+               st[k].unique_id, st[k].runs, st[k].avg_ms, st[k].max_ms, st[k].last_ms, st[k].timeouts, st[k].failures);
+    }
+    free(st);
+}
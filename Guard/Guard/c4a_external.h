@@ -0,0 +1,38 @@
+#ifndef C4A_EXTERNAL_H
+#define C4A_EXTERNAL_H
+
+#include "c4a_types.h"
+
+// Runs the pcheck.sh probes (external triggers, plus name/command triggers on
+// platforms without native detection) on a small worker pool. Each probe runs
+// in its own process group and is killed at its rule's
+// trigger_timeout_in_seconds (default C4A_EXTERNAL_TIMEOUT_SECONDS). Results
+// are reused for C4A_EXTERNAL_TTL_SECONDS, so one slow rule no longer stalls
+// the tick.
+
+// Starts the probes that are due for ctx. Only probes without any result yet
+// are waited for, up to C4A_EXTERNAL_JOIN_MS; the rest finish in the
+// background and are picked up by a later call, the previous result standing
+// until then. native_ok says name and command triggers were already matched
+// in-process.
+int c4a_external_refresh(C4aContext *ctx, int native_ok);
+// Copies the latest result for app i of ctx. Returns 1 if the app is handled
+// by the executor, 0 otherwise (out untouched).
+int c4a_external_result(const C4aContext *ctx, size_t i, C4aPidSet *out);
+
+typedef struct {
+    char unique_id[128];
+    uint64_t runs;
+    uint64_t timeouts;
+    uint64_t failures;
+    double last_ms;
+    double avg_ms;
+    double max_ms;
+} C4aExternalStat;
+
+// Fills up to max per-rule latency records. Returns the number of rules.
+size_t c4a_external_stats(C4aExternalStat *out, size_t max);
+// Logs the slowest rules to syslog.
+void c4a_external_log_stats(void);
+
+#endif
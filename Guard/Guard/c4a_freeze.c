@@ -0,0 +1,179 @@
+#include "include.h"
+#include "c4a_freeze.h"
+#include "c4a_kill.h"
+#include "c4a_cgroup.h"
+#include "detection.h"
+
+// Every process this guard holds stopped, across apps. A fatal signal
+// handler resumes them from here (c4a_freeze_release_all), and a copy in
+// C4A_FREEZE_STATE_FILE lets the next start resume them after a SIGKILL.
+// Released slots are zeroed rather than moved, so the handler never sees a
+// half-moved entry.
+static struct { volatile pid_t pid; uint64_t start; } g_held[C4A_FREEZE_MAX_HELD];
+static volatile size_t g_held_n;
+static int g_held_dirty;
+
+static int held_add(pid_t pid, uint64_t start) {
+    size_t k = 0;
+    while (k < g_held_n && g_held[k].pid != 0) ++k;
+    if (k == C4A_FREEZE_MAX_HELD) {
+        syslog(LOG_WARNING, "Too many frozen processes to track %d for recovery", (int)pid);
+        return -1;
+    }
+    g_held[k].start = start;
+    g_held[k].pid = pid;
+    if (k == g_held_n) g_held_n = k + 1;
+    g_held_dirty = 1;
+    return 0;
+}
+
+static void held_drop(pid_t pid) {
+    for (size_t k = 0; k < g_held_n; ++k) {
+        if (g_held[k].pid == pid) { g_held[k].pid = 0; g_held_dirty = 1; }
+    }
+    while (g_held_n > 0 && g_held[g_held_n - 1].pid == 0) g_held_n--;
+}
+
+static void held_release(const C4aPidSet *set) {
+    const C4aProcRef *it = c4a_pidset_citems(set);
+    for (int i = 0; i < set->len; ++i) held_drop(it[i].pid);
+}
+
+// Rewrites C4A_FREEZE_STATE_FILE after the held set changed.
+static void held_save(void) {
+    if (!g_held_dirty) return;
+    g_held_dirty = 0;
+    if (g_held_n == 0) { unlink(C4A_FREEZE_STATE_FILE); return; }
+    FILE *f = fopen(C4A_FREEZE_STATE_FILE ".tmp", "w");
+    if (!f) { syslog(LOG_WARNING, "Could not record frozen processes (%d)", errno); return; }
+    for (size_t k = 0; k < g_held_n; ++k) {
+        if (g_held[k].pid) fprintf(f, "%d %llu\n", (int)g_held[k].pid, (unsigned long long)g_held[k].start);
+    }
+    if (fclose(f) != 0 || rename(C4A_FREEZE_STATE_FILE ".tmp", C4A_FREEZE_STATE_FILE) != 0) {
+        syslog(LOG_WARNING, "Could not record frozen processes (%d)", errno);
+    }
+}
+
+void c4a_freeze_release_all(void) {
+    c4a_cgroup_release_all();
+    for (size_t k = 0; k < g_held_n; ++k) {
+        pid_t pid = g_held[k].pid;
+        if (pid > 1) kill(pid, SIGCONT);
+    }
+}
+
+int c4a_freeze_recover(void) {
+    FILE *f = fopen(C4A_FREEZE_STATE_FILE, "r");
+    if (!f) return 0;
+    int pid, n = 0;
+    unsigned long long start;
+    while (fscanf(f, "%d %llu", &pid, &start) == 2) {
+        if (pid > 1 && pid != getpid() && c4a_proc_is((pid_t)pid, (uint64_t)start) && kill((pid_t)pid, SIGCONT) == 0) n++;
+    }
+    fclose(f);
+    unlink(C4A_FREEZE_STATE_FILE);
+    if (n > 0) syslog(LOG_NOTICE, "Resumed %d processes left frozen by a previous guard", n);
+    return n;
+}
+
+static C4aPidSet g_untracked;
+
+static int stop_one(C4aApp *app, pid_t pid, uint64_t start) {
+    if (pid <= 1 || pid == getpid()) return 0;
+    if (c4a_pidset_find(&app->frozen, pid) >= 0) return 0;
+    if (!c4a_proc_is(pid, start)) return 0;
+    // Recorded first: a crash right after the SIGSTOP must still find it. One
+    // that cannot be recorded is never stopped; it goes on the tick's kill
+    // batch instead.
+    if (held_add(pid, start) != 0) {
+        g_untracked.len = 0;
+        c4a_pidset_push(&g_untracked, pid, start);
+        c4a_kill_add(&g_untracked);
+        return 0;
+    }
+    if (kill(pid, SIGSTOP) != 0) { held_drop(pid); return 0; }
+    c4a_pidset_push(&app->frozen, pid, start);
+    return 1;
+}
+
+#ifdef __linux__
+static C4aPidSet g_scratch;
+
+// Stops every descendant of a frozen process. Parents are already stopped, so
+// a repeat scan only has to catch children forked just before that.
+static int stop_descendants(C4aApp *app) {
+    g_scratch.len = 0;
+    if (c4a_proc_descendants(&app->frozen, &g_scratch) != 0) return 0;
+    int stopped = 0;
+    const C4aProcRef *it = c4a_pidset_citems(&g_scratch);
+    for (int i = 0; i < g_scratch.len; ++i) stopped += stop_one(app, it[i].pid, it[i].start);
+    return stopped;
+}
+#endif
+
+static void copy_pids(C4aPidSet *dst, const C4aPidSet *src) {
+    dst->len = 0;
+    const C4aProcRef *it = c4a_pidset_citems(src);
+    for (int i = 0; i < src->len; ++i) c4a_pidset_push(dst, it[i].pid, it[i].start);
+}
+
+int c4a_freeze_app(C4aApp *app, double now) {
+    if (!app) return 0;
+    if (app->frozen.len == 0) app->frozen_since_mono = now;
+    if (!app->cgroup_strays && (app->cgroup_frozen || (app->cgroup && c4a_cgroup_freeze(app, 1) == 0))) {
+        // The whole cgroup is frozen, including anything that joins it later.
+        // With detected processes outside it, every pid is stopped instead.
+        int added = app->pids.len - app->frozen.len;
+        copy_pids(&app->frozen, &app->pids);
+        if (added > 0) syslog(LOG_NOTICE, "Froze %s (cgroup)", app->settings.unique_id ?: "");
+        return added > 0 ? added : 0;
+    }
+    int stopped = 0;
+    const C4aProcRef *it = c4a_pidset_citems(&app->pids);
+    for (int i = 0; i < app->pids.len; ++i) stopped += stop_one(app, it[i].pid, it[i].start);
+#ifdef __linux__
+    for (int pass = 0; pass < 3 && app->frozen.len > 0; ++pass) {
+        int n = stop_descendants(app);
+        stopped += n;
+        if (n == 0) break;
+    }
+#endif
+    held_save();
+    if (stopped > 0) {
+        syslog(LOG_NOTICE, "Froze %s (%d processes)", app->settings.unique_id ?: "", stopped);
+    }
+    return stopped;
+}
+
+static void signal_frozen(C4aApp *app, int sig) {
+    const C4aProcRef *it = c4a_pidset_citems(&app->frozen);
+    for (int i = 0; i < app->frozen.len; ++i) {
+        if (c4a_proc_is(it[i].pid, it[i].start)) kill(it[i].pid, sig);
+    }
+}
+
+int c4a_freeze_thaw(C4aApp *app) {
+    if (!app || app->frozen.len == 0) return 0;
+    int n = app->frozen.len;
+    if (app->cgroup_frozen) c4a_cgroup_freeze(app, 0);
+    signal_frozen(app, SIGCONT);
+    held_release(&app->frozen);
+    held_save();
+    app->frozen.len = 0;
+    syslog(LOG_NOTICE, "Thawed %s", app->settings.unique_id ?: "");
+    return n;
+}
+
+int c4a_freeze_terminate(C4aApp *app) {
+    if (!app || app->frozen.len == 0) return 0;
+    // SIGTERM stays pending on a stopped process; SIGCONT lets it act on it.
+    int n = c4a_kill_add(&app->frozen);
+    char dir[PATH_MAX];
+    if (c4a_cgroup_path(app, dir, sizeof(dir)) == 0) c4a_kill_add_group(dir);
+    if (app->cgroup_frozen) c4a_cgroup_freeze(app, 0);
+    signal_frozen(app, SIGCONT);
+    held_release(&app->frozen);
+    held_save();
+    app->frozen.len = 0;
+    return n;
+}
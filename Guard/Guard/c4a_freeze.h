@@ -0,0 +1,30 @@
+#ifndef C4A_FREEZE_H
+#define C4A_FREEZE_H
+
+#include "c4a_types.h"
+
+// Freeze-then-gate (C4A_GATE_FREEZE=1): instead of killing a gated app, its
+// process tree is stopped while the challenge runs, resumed on pass and
+// terminated on fail or after C4A_GATE_FREEZE_TIMEOUT_SECONDS. The app keeps
+// its state, so passing a challenge does not cost a cold start. Apps placed in
+// a cgroup (c4a_cgroup.h) are frozen through cgroup.freeze instead of SIGSTOP.
+
+// Stops app->pids and (on Linux) their descendants, adding them to
+// app->frozen. Already frozen processes are left alone; a new freeze starts
+// its timeout at now. A process that cannot be recorded for recovery
+// (C4A_FREEZE_MAX_HELD) is queued on the current kill batch instead of being
+// stopped. Returns the number newly stopped.
+int c4a_freeze_app(C4aApp *app, double now);
+// Resumes everything in app->frozen and empties it.
+int c4a_freeze_thaw(C4aApp *app);
+// Terminates everything in app->frozen through the current kill batch
+// (c4a_kill.h) and empties it.
+int c4a_freeze_terminate(C4aApp *app);
+// Thaws every cgroup and SIGCONTs every process this guard stopped.
+// Async-signal-safe: installed as the fatal-signal hook (c4a_trace_on_fatal).
+void c4a_freeze_release_all(void);
+// Resumes the processes a previous guard left stopped (it crashed or was
+// killed), as recorded in C4A_FREEZE_STATE_FILE. Returns how many.
+int c4a_freeze_recover(void);
+
+#endif
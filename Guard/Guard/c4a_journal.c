@@ -0,0 +1,447 @@
+#include "include.h"
+#include "c4a_journal.h"
+#include <fcntl.h>
+
+#define JOURNAL_MAGIC 0x4a413443u   // "C4AJ"
+#define FIELD_COUNT 14
+#define FIELDS_ALL ((1u << FIELD_COUNT) - 1)
+
+// Record: magic, payload length, CRC-32 of the payload, then the payload:
+// uid length (u16), uid, field mask (u16), and the masked fields in column
+// order. Integers and doubles are 8 bytes, strings a u32 length and bytes.
+// Host byte order: the journal never leaves the machine.
+typedef struct {
+    uint32_t magic;
+    uint32_t len;
+    uint32_t crc;
+} RecHead;
+
+typedef struct {
+    char *uid;
+    C4aAppMemory img;
+    int unsynced;               // appended since the last good sync
+} Entry;
+
+typedef struct {
+    unsigned char *p;
+    size_t len, cap;
+} Buf;
+
+static Entry *g_entries;
+static size_t g_count, g_cap;
+static int *g_index;            // open addressing into g_entries, -1 = empty
+static size_t g_index_cap;
+static int g_fd = -1;
+static char *g_snapshot_path;
+static off_t g_bytes;           // journal length up to the last whole record
+static int g_unsynced;
+static int g_sync_failed;       // unsynced entries are resent in full
+static C4aJournalStats g_stats;
+
+static int journal_datasync(int fd) {
+#ifdef __APPLE__
+    return fsync(fd);
+#else
+    return fdatasync(fd);
+#endif
+}
+
+static uint32_t crc32_of(const unsigned char *p, size_t n) {
+    static uint32_t table[256];
+    static int ready = 0;
+    if (!ready) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        ready = 1;
+    }
+    uint32_t c = 0xffffffffu;
+    for (size_t i = 0; i < n; ++i) c = table[(c ^ p[i]) & 0xff] ^ (c >> 8);
+    return c ^ 0xffffffffu;
+}
+
+static size_t uid_hash(const char *s, size_t len, size_t cap) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) { h ^= (unsigned char)s[i]; h *= 1099511628211ULL; }
+    return (size_t)h & (cap - 1);
+}
+
+static int find_entry(const char *uid, size_t len) {
+    if (!g_index) return -1;
+    for (size_t h = uid_hash(uid, len, g_index_cap);; h = (h + 1) & (g_index_cap - 1)) {
+        int e = g_index[h];
+        if (e < 0) return -1;
+        if (strlen(g_entries[e].uid) == len && memcmp(g_entries[e].uid, uid, len) == 0) return e;
+    }
+}
+
+static int add_entry(const char *uid, size_t len) {
+    if ((g_count + 1) * 2 > g_index_cap) {
+        size_t ncap = g_index_cap ? g_index_cap * 2 : 256;
+        int *ni = malloc(ncap * sizeof(int));
+        if (!ni) return -1;
+        for (size_t i = 0; i < ncap; ++i) ni[i] = -1;
+        for (size_t e = 0; e < g_count; ++e) {
+            size_t h = uid_hash(g_entries[e].uid, strlen(g_entries[e].uid), ncap);
+            while (ni[h] >= 0) h = (h + 1) & (ncap - 1);
+            ni[h] = (int)e;
+        }
+        free(g_index);
+        g_index = ni; g_index_cap = ncap;
+    }
+    if (g_count == g_cap) {
+        size_t ncap = g_cap ? g_cap * 2 : 64;
+        Entry *ne = realloc(g_entries, ncap * sizeof(Entry));
+        if (!ne) return -1;
+        g_entries = ne; g_cap = ncap;
+    }
+    Entry *en = &g_entries[g_count];
+    memset(en, 0, sizeof(*en));
+    en->uid = strndup(uid, len);
+    if (!en->uid) return -1;
+    size_t h = uid_hash(uid, len, g_index_cap);
+    while (g_index[h] >= 0) h = (h + 1) & (g_index_cap - 1);
+    g_index[h] = (int)g_count;
+    return (int)g_count++;
+}
+
+static int buf_put(Buf *b, const void *p, size_t n) {
+    if (b->len + n > b->cap) {
+        size_t ncap = b->cap ? b->cap * 2 : 256;
+        while (ncap < b->len + n) ncap *= 2;
+        unsigned char *np = realloc(b->p, ncap);
+        if (!np) return -1;
+        b->p = np; b->cap = ncap;
+    }
+    memcpy(b->p + b->len, p, n);
+    b->len += n;
+    return 0;
+}
+
+static int buf_put_i64(Buf *b, int64_t v) { return buf_put(b, &v, sizeof(v)); }
+static int buf_put_f64(Buf *b, double v) { return buf_put(b, &v, sizeof(v)); }
+static int buf_put_str(Buf *b, const char *s) {
+    uint32_t n = s ? (uint32_t)strlen(s) : 0;
+    if (buf_put(b, &n, sizeof(n)) != 0) return -1;
+    return buf_put(b, s ? s : "", n);
+}
+
+static int str_same(const char *a, const char *b) {
+    return strcmp(a ? a : "", b ? b : "") == 0;
+}
+static int f64_same(double a, double b) {
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// Mask of the columns where m differs from the stored image.
+static unsigned changed_fields(const C4aAppMemory *o, const C4aAppMemory *m) {
+    unsigned mask = 0;
+    if (o->cooled != m->cooled) mask |= 1u << 0;
+    if (!str_same(o->last_seen_running_timestamp, m->last_seen_running_timestamp)) mask |= 1u << 1;
+    if (o->lifetime_opens != m->lifetime_opens) mask |= 1u << 2;
+    if (o->opens_since_last_cooled != m->opens_since_last_cooled) mask |= 1u << 3;
+    if (!str_same(o->date_time_of_last_free_open, m->date_time_of_last_free_open)) mask |= 1u << 4;
+    if (!f64_same(o->current_heat, m->current_heat)) mask |= 1u << 5;
+    if (!f64_same(o->last_heat, m->last_heat)) mask |= 1u << 6;
+    if (!f64_same(o->current_temperature, m->current_temperature)) mask |= 1u << 7;
+    if (!str_same(o->last_open_time, m->last_open_time)) mask |= 1u << 8;
+    if (o->burned != m->burned) mask |= 1u << 9;
+    if (o->burned_forever != m->burned_forever) mask |= 1u << 10;
+    if (o->lifetime_numbr_of_times_burned != m->lifetime_numbr_of_times_burned) mask |= 1u << 11;
+    if (!f64_same(o->hours_remaining_until_not_burned, m->hours_remaining_until_not_burned)) mask |= 1u << 12;
+    if (!str_same(o->last_burned_date_time, m->last_burned_date_time)) mask |= 1u << 13;
+    return mask;
+}
+
+// Appends a whole record (header included) for uid's masked columns of m.
+static int encode_record(Buf *b, const char *uid, unsigned mask, const C4aAppMemory *m) {
+    RecHead h = { JOURNAL_MAGIC, 0, 0 };
+    size_t start = b->len;
+    uint16_t ulen = (uint16_t)strlen(uid), m16 = (uint16_t)mask;
+    int bad = buf_put(b, &h, sizeof(h));
+    bad |= buf_put(b, &ulen, sizeof(ulen));
+    bad |= buf_put(b, uid, ulen);
+    bad |= buf_put(b, &m16, sizeof(m16));
+    if (mask & (1u << 0)) bad |= buf_put_i64(b, m->cooled);
+    if (mask & (1u << 1)) bad |= buf_put_str(b, m->last_seen_running_timestamp);
+    if (mask & (1u << 2)) bad |= buf_put_i64(b, m->lifetime_opens);
+    if (mask & (1u << 3)) bad |= buf_put_i64(b, m->opens_since_last_cooled);
+    if (mask & (1u << 4)) bad |= buf_put_str(b, m->date_time_of_last_free_open);
+    if (mask & (1u << 5)) bad |= buf_put_f64(b, m->current_heat);
+    if (mask & (1u << 6)) bad |= buf_put_f64(b, m->last_heat);
+    if (mask & (1u << 7)) bad |= buf_put_f64(b, m->current_temperature);
+    if (mask & (1u << 8)) bad |= buf_put_str(b, m->last_open_time);
+    if (mask & (1u << 9)) bad |= buf_put_i64(b, m->burned);
+    if (mask & (1u << 10)) bad |= buf_put_i64(b, m->burned_forever);
+    if (mask & (1u << 11)) bad |= buf_put_i64(b, m->lifetime_numbr_of_times_burned);
+    if (mask & (1u << 12)) bad |= buf_put_f64(b, m->hours_remaining_until_not_burned);
+    if (mask & (1u << 13)) bad |= buf_put_str(b, m->last_burned_date_time);
+    if (bad) { b->len = start; return -1; }
+    h.len = (uint32_t)(b->len - start - sizeof(h));
+    h.crc = crc32_of(b->p + start + sizeof(h), h.len);
+    memcpy(b->p + start, &h, sizeof(h));
+    return 0;
+}
+
+typedef struct {
+    const unsigned char *p;
+    size_t left;
+    int bad;
+} Reader;
+
+static void rd(Reader *r, void *out, size_t n) {
+    if (r->bad || r->left < n) { r->bad = 1; memset(out, 0, n); return; }
+    memcpy(out, r->p, n);
+    r->p += n; r->left -= n;
+}
+static int64_t rd_i64(Reader *r) { int64_t v; rd(r, &v, sizeof(v)); return v; }
+static double rd_f64(Reader *r) { double v; rd(r, &v, sizeof(v)); return v; }
+static void rd_str(Reader *r, char **dst) {
+    uint32_t n;
+    rd(r, &n, sizeof(n));
+    if (r->bad || r->left < n) { r->bad = 1; return; }
+    char *s = strndup((const char*)r->p, n);
+    if (!s) { r->bad = 1; return; }
+    r->p += n; r->left -= n;
+    free(*dst);
+    *dst = s;
+}
+
+// Applies one checksummed payload to the in-memory images.
+static int apply_payload(const unsigned char *p, size_t len) {
+    Reader r = { p, len, 0 };
+    uint16_t ulen, mask;
+    rd(&r, &ulen, sizeof(ulen));
+    if (r.bad || r.left < ulen) return -1;
+    const char *uid = (const char*)r.p;
+    r.p += ulen; r.left -= ulen;
+    rd(&r, &mask, sizeof(mask));
+    if (r.bad) return -1;
+    int e = find_entry(uid, ulen);
+    if (e < 0) e = add_entry(uid, ulen);
+    if (e < 0) return -1;
+    C4aAppMemory *m = &g_entries[e].img;
+    if (mask & (1u << 0)) m->cooled = (int)rd_i64(&r);
+    if (mask & (1u << 1)) rd_str(&r, &m->last_seen_running_timestamp);
+    if (mask & (1u << 2)) m->lifetime_opens = rd_i64(&r);
+    if (mask & (1u << 3)) m->opens_since_last_cooled = rd_i64(&r);
+    if (mask & (1u << 4)) rd_str(&r, &m->date_time_of_last_free_open);
+    if (mask & (1u << 5)) m->current_heat = rd_f64(&r);
+    if (mask & (1u << 6)) m->last_heat = rd_f64(&r);
+    if (mask & (1u << 7)) m->current_temperature = rd_f64(&r);
+    if (mask & (1u << 8)) rd_str(&r, &m->last_open_time);
+    if (mask & (1u << 9)) m->burned = (int)rd_i64(&r);
+    if (mask & (1u << 10)) m->burned_forever = (int)rd_i64(&r);
+    if (mask & (1u << 11)) m->lifetime_numbr_of_times_burned = rd_i64(&r);
+    if (mask & (1u << 12)) m->hours_remaining_until_not_burned = rd_f64(&r);
+    if (mask & (1u << 13)) rd_str(&r, &m->last_burned_date_time);
+    return r.bad ? -1 : 0;
+}
+
+// Replays path. Returns the length of its valid prefix, or -1 if it cannot
+// be read (a missing file is empty).
+static off_t replay_file(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return errno == ENOENT ? 0 : -1;
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) { close(fd); return -1; }
+    size_t size = (size_t)sb.st_size;
+    unsigned char *data = malloc(size ? size : 1);
+    if (!data) { close(fd); return -1; }
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = read(fd, data + got, size - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    close(fd);
+    size_t off = 0;
+    while (off + sizeof(RecHead) <= got) {
+        RecHead h;
+        memcpy(&h, data + off, sizeof(h));
+        if (h.magic != JOURNAL_MAGIC || h.len > got - off - sizeof(h)) break;
+        const unsigned char *payload = data + off + sizeof(h);
+        if (crc32_of(payload, h.len) != h.crc) break;
+        if (apply_payload(payload, h.len) != 0) break;
+        off += sizeof(h) + h.len;
+    }
+    if (off < got) syslog(LOG_WARNING, "%s: ignoring %zu bytes after the last whole record", path, got - off);
+    free(data);
+    return (off_t)off;
+}
+
+int c4a_journal_open(const char *journal_path, const char *snapshot_path) {
+    if (g_fd >= 0) return 0;
+    if (replay_file(snapshot_path) < 0) syslog(LOG_WARNING, "memory snapshot %s unreadable", snapshot_path);
+    off_t valid = replay_file(journal_path);
+    if (valid < 0) return -1;
+    int fd = open(journal_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        syslog(LOG_ERR, "memory journal %s: %s", journal_path, strerror(errno));
+        return -1;
+    }
+    // Cut a torn or corrupt tail so new records follow the last good one.
+    if (ftruncate(fd, valid) != 0) { close(fd); return -1; }
+    g_snapshot_path = strdup(snapshot_path);
+    if (!g_snapshot_path) { close(fd); return -1; }
+    g_fd = fd;
+    g_bytes = valid;
+    return 0;
+}
+
+int c4a_journal_read(const char *journal_path, const char *snapshot_path) {
+    if (replay_file(snapshot_path) < 0) syslog(LOG_WARNING, "memory snapshot %s unreadable", snapshot_path);
+    return replay_file(journal_path) < 0 ? -1 : 0;
+}
+
+void c4a_journal_close(void) {
+    if (g_fd < 0) return;
+    c4a_journal_sync();
+    close(g_fd);
+    g_fd = -1;
+    free(g_snapshot_path);
+    g_snapshot_path = NULL;
+}
+
+static char *dup_or_null(const char *s) {
+    return s ? strdup(s) : NULL;
+}
+
+static void copy_strings(C4aAppMemory *dst, const C4aAppMemory *src) {
+    free(dst->last_seen_running_timestamp); dst->last_seen_running_timestamp = dup_or_null(src->last_seen_running_timestamp);
+    free(dst->date_time_of_last_free_open); dst->date_time_of_last_free_open = dup_or_null(src->date_time_of_last_free_open);
+    free(dst->last_open_time); dst->last_open_time = dup_or_null(src->last_open_time);
+    free(dst->last_burned_date_time); dst->last_burned_date_time = dup_or_null(src->last_burned_date_time);
+}
+
+static void copy_image(C4aAppMemory *dst, const C4aAppMemory *src) {
+    C4aAppMemory keep = *dst;
+    *dst = *src;
+    dst->last_seen_running_timestamp = keep.last_seen_running_timestamp;
+    dst->date_time_of_last_free_open = keep.date_time_of_last_free_open;
+    dst->last_open_time = keep.last_open_time;
+    dst->last_burned_date_time = keep.last_burned_date_time;
+    copy_strings(dst, src);
+}
+
+int c4a_journal_load(const char *uid, C4aAppMemory *mem) {
+    int e = find_entry(uid, strlen(uid));
+    if (e < 0) return 0;
+    copy_image(mem, &g_entries[e].img);
+    return 1;
+}
+
+static int append(const Buf *b) {
+    size_t done = 0;
+    while (done < b->len) {
+        ssize_t n = write(g_fd, b->p + done, b->len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            // Drop the partial record so the journal stays parseable.
+            syslog(LOG_ERR, "memory journal write failed: %s", strerror(errno));
+            if (ftruncate(g_fd, g_bytes) != 0) syslog(LOG_ERR, "memory journal truncate failed: %s", strerror(errno));
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    g_bytes += (off_t)b->len;
+    g_unsynced = 1;
+    __atomic_fetch_add(&g_stats.appends, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int c4a_journal_save(const char *uid, const C4aAppMemory *mem, int sync) {
+    if (g_fd < 0 || !uid || strlen(uid) > UINT16_MAX) return -1;
+    int e = find_entry(uid, strlen(uid));
+    // After a failed sync g_entries may be ahead of the disk; the image is
+    // rewritten whole rather than diffed against it.
+    unsigned mask = e < 0 || (g_sync_failed && g_entries[e].unsynced) ? FIELDS_ALL : changed_fields(&g_entries[e].img, mem);
+    if (mask == 0) return 0;
+    Buf b = { NULL, 0, 0 };
+    if (encode_record(&b, uid, mask, mem) != 0) { free(b.p); return -1; }
+    int rc = append(&b);
+    free(b.p);
+    if (rc != 0) return -1;
+    if (e < 0) e = add_entry(uid, strlen(uid));
+    if (e >= 0) { copy_image(&g_entries[e].img, mem); g_entries[e].unsynced = 1; }
+    return sync ? c4a_journal_sync() : 0;
+}
+
+// Makes a rename in path's directory durable.
+static int sync_parent(const char *path) {
+    char dir[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    if (!slash) snprintf(dir, sizeof(dir), ".");
+    else snprintf(dir, sizeof(dir), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    int rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+// Writes every image as a full record to the snapshot (through a temporary
+// file and rename), then empties the journal. Replaying the old journal over
+// the new snapshot, after a crash in between, leaves the same images.
+static int compact(void) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", g_snapshot_path);
+    Buf b = { NULL, 0, 0 };
+    for (size_t e = 0; e < g_count; ++e) {
+        if (encode_record(&b, g_entries[e].uid, FIELDS_ALL, &g_entries[e].img) != 0) { free(b.p); return -1; }
+    }
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) { free(b.p); return -1; }
+    size_t done = 0;
+    int bad = 0;
+    while (done < b.len) {
+        ssize_t n = write(fd, b.p + done, b.len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { bad = 1; break; }
+        done += (size_t)n;
+    }
+    free(b.p);
+    if (journal_datasync(fd) != 0) bad = 1;
+    if (close(fd) != 0) bad = 1;
+    if (bad || rename(tmp, g_snapshot_path) != 0) {
+        syslog(LOG_WARNING, "memory snapshot %s not written", g_snapshot_path);
+        unlink(tmp);
+        return -1;
+    }
+    // The truncation below must not reach the disk before the rename.
+    if (sync_parent(g_snapshot_path) != 0) {
+        syslog(LOG_WARNING, "memory snapshot %s: directory sync failed: %s", g_snapshot_path, strerror(errno));
+        return -1;
+    }
+    if (ftruncate(g_fd, 0) != 0 || journal_datasync(g_fd) != 0) return -1;
+    g_bytes = 0;
+    __atomic_fetch_add(&g_stats.compactions, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int c4a_journal_sync(void) {
+    if (g_fd < 0) return -1;
+    if (g_unsynced) {
+        __atomic_fetch_add(&g_stats.syncs, 1, __ATOMIC_RELAXED);
+        if (journal_datasync(g_fd) != 0) {
+            syslog(LOG_ERR, "memory journal sync failed: %s", strerror(errno));
+            g_sync_failed = 1;
+            return -1;
+        }
+        g_unsynced = 0;
+        g_sync_failed = 0;
+        for (size_t e = 0; e < g_count; ++e) g_entries[e].unsynced = 0;
+    }
+    if (g_bytes > (off_t)C4A_JOURNAL_COMPACT_BYTES) compact();
+    return 0;
+}
+
+void c4a_journal_stats(C4aJournalStats *out) {
+    if (!out) return;
+    out->appends = __atomic_load_n(&g_stats.appends, __ATOMIC_RELAXED);
+    out->syncs = __atomic_load_n(&g_stats.syncs, __ATOMIC_RELAXED);
+    out->compactions = __atomic_load_n(&g_stats.compactions, __ATOMIC_RELAXED);
+}
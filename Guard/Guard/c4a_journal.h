@@ -0,0 +1,38 @@
+#ifndef C4A_JOURNAL_H
+#define C4A_JOURNAL_H
+
+#include "c4a_types.h"
+
+// Append-only app memory store (the C4A_STORE_JOURNAL backend of
+// c4a_store.c). Each save appends one checksummed record holding only the
+// columns that changed since the app's last record. Records reach the disk
+// together at c4a_journal_sync; once the journal passes
+// C4A_JOURNAL_COMPACT_BYTES it is folded into a snapshot of full records and
+// truncated. Opening replays snapshot then journal, and cuts a torn tail off
+// the journal.
+
+typedef struct {
+    uint64_t appends;
+    uint64_t syncs;
+    uint64_t compactions;
+} C4aJournalStats;
+
+// Opens (creating as needed) and replays the files. Later calls do nothing.
+int c4a_journal_open(const char *journal_path, const char *snapshot_path);
+void c4a_journal_close(void);
+// Replays the files for c4a_journal_load without opening them for writing:
+// nothing is created or truncated. Saving still needs c4a_journal_open.
+int c4a_journal_read(const char *journal_path, const char *snapshot_path);
+// Copies uid's stored memory into mem. Returns 1 if found, 0 if not.
+int c4a_journal_load(const char *uid, C4aAppMemory *mem);
+// Appends the columns of mem that differ from uid's stored memory. With
+// sync the record is on disk before returning; otherwise it waits for the
+// next c4a_journal_sync. Returns 0 on success.
+int c4a_journal_save(const char *uid, const C4aAppMemory *mem, int sync);
+// Flushes appended records with one fdatasync and compacts if due. After a
+// failure the next save of each app appended since the last good sync writes
+// its whole memory, so a re-offered app is never skipped as unchanged.
+int c4a_journal_sync(void);
+void c4a_journal_stats(C4aJournalStats *out);
+
+#endif
@@ -0,0 +1,154 @@
+#ifdef __linux__
+#define _GNU_SOURCE // syscall() for pidfd_open / pidfd_send_signal
+#endif
+#include "include.h"
+#include <poll.h>
+#include "c4a_kill.h"
+#include "c4a_time.h"
+#include "detection.h"
+#include "c4a_trace.h"
+
+#if defined(__linux__) && defined(SYS_pidfd_open) && defined(SYS_pidfd_send_signal)
+#define C4A_HAVE_PIDFD 1
+#else
+#define C4A_HAVE_PIDFD 0
+#endif
+
+typedef struct {
+    pid_t pid;
+    uint64_t start;
+    int pidfd;      // pins the process we signalled; -1 if unavailable
+    int alive;
+} C4aKillTarget;
+
+static struct {
+    C4aKillTarget *t;
+    size_t len, cap;
+    char **groups;
+    size_t ngroups, gcap;
+} g_batch;
+
+static int target_signal(const C4aKillTarget *k, int sig) {
+    c4a_trace(C4A_TR_KILL, -1, k->pid, sig);
+#if C4A_HAVE_PIDFD
+    if (k->pidfd >= 0) return (int)syscall(SYS_pidfd_send_signal, k->pidfd, sig, NULL, 0);
+#endif
+    if (!c4a_proc_is(k->pid, k->start)) { errno = ESRCH; return -1; }
+    return kill(k->pid, sig);
+}
+
+static void target_close(C4aKillTarget *k) {
+    if (k->pidfd >= 0) close(k->pidfd);
+    k->pidfd = -1;
+    k->alive = 0;
+}
+
+static void groups_clear(void) {
+    for (size_t i = 0; i < g_batch.ngroups; ++i) free(g_batch.groups[i]);
+    g_batch.ngroups = 0;
+}
+
+void c4a_kill_begin(void) {
+    for (size_t i = 0; i < g_batch.len; ++i) target_close(&g_batch.t[i]);
+    g_batch.len = 0;
+    groups_clear();
+}
+
+int c4a_kill_add_group(const char *cgroup_dir) {
+    if (!cgroup_dir || !*cgroup_dir) return -1;
+    for (size_t i = 0; i < g_batch.ngroups; ++i) {
+        if (strcmp(g_batch.groups[i], cgroup_dir) == 0) return 0;
+    }
+    if (g_batch.ngroups == g_batch.gcap) {
+        size_t ncap = g_batch.gcap ? g_batch.gcap * 2 : 8;
+        char **ng = realloc(g_batch.groups, ncap * sizeof(char *));
+        if (!ng) return -1;
+        g_batch.groups = ng; g_batch.gcap = ncap;
+    }
+    char *d = strdup(cgroup_dir);
+    if (!d) return -1;
+    g_batch.groups[g_batch.ngroups++] = d;
+    return 0;
+}
+
+static void kill_group(const char *dir) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/cgroup.kill", dir);
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    if (write(fd, "1", 1) != 1) {
+        syslog(LOG_WARNING, "cgroup.kill failed for %s (%d)", dir, errno);
+    }
+    close(fd);
+}
+
+int c4a_kill_add(const C4aPidSet *set) {
+    int signalled = 0;
+    const C4aProcRef *it = c4a_pidset_citems(set);
+    for (int i = 0; i < set->len; ++i) {
+        if (it[i].pid <= 1) continue;
+        int dup = 0;
+        for (size_t j = 0; j < g_batch.len && !dup; ++j) dup = (g_batch.t[j].pid == it[i].pid);
+        if (dup) continue;
+        if (g_batch.len == g_batch.cap) {
+            size_t ncap = g_batch.cap ? g_batch.cap * 2 : 16;
+            C4aKillTarget *nt = realloc(g_batch.t, ncap * sizeof(C4aKillTarget));
+            if (!nt) break;
+            g_batch.t = nt; g_batch.cap = ncap;
+        }
+        C4aKillTarget k = { it[i].pid, it[i].start, -1, 0 };
+#if C4A_HAVE_PIDFD
+        // Open the pidfd first, then confirm identity: from here on the
+        // descriptor cannot refer to a recycled pid.
+        k.pidfd = (int)syscall(SYS_pidfd_open, k.pid, 0);
+#endif
+        if (!c4a_proc_is(k.pid, k.start)) { target_close(&k); continue; }
+        if (target_signal(&k, SIGTERM) != 0) { target_close(&k); continue; }
+        k.alive = 1;
+        g_batch.t[g_batch.len++] = k;
+        signalled++;
+    }
+    return signalled;
+}
+
+int c4a_kill_flush(double grace) {
+    double deadline = c4a_mono_now() + grace;
+    struct pollfd pfds[64];
+    size_t idx[64];
+    for (;;) {
+        int nfds = 0, unwatched = 0, alive = 0;
+        for (size_t i = 0; i < g_batch.len; ++i) {
+            C4aKillTarget *k = &g_batch.t[i];
+            if (!k->alive) continue;
+            if (k->pidfd < 0 || nfds == (int)(sizeof(pfds) / sizeof(pfds[0]))) {
+                // No descriptor to wait on: probe for the process directly.
+                if (kill(k->pid, 0) != 0 || !c4a_proc_is(k->pid, k->start)) { target_close(k); continue; }
+                unwatched = 1;
+            } else {
+                pfds[nfds] = (struct pollfd){ .fd = k->pidfd, .events = POLLIN };
+                idx[nfds++] = i;
+            }
+            alive++;
+        }
+        if (alive == 0) break;
+        double left = deadline - c4a_mono_now();
+        if (left <= 0) break;
+        int ms = (int)(left * 1000.0) + 1;
+        if (unwatched && ms > 20) ms = 20;
+        int pr = poll(pfds, (nfds_t)nfds, ms);
+        if (pr < 0 && errno != EINTR) break;
+        for (int j = 0; pr > 0 && j < nfds; ++j) {
+            if (pfds[j].revents) target_close(&g_batch.t[idx[j]]);
+        }
+    }
+    int escalated = 0;
+    for (size_t i = 0; i < g_batch.len; ++i) {
+        C4aKillTarget *k = &g_batch.t[i];
+        if (k->alive && target_signal(k, SIGKILL) == 0) escalated++;
+        target_close(k);
+    }
+    g_batch.len = 0;
+    for (size_t i = 0; i < g_batch.ngroups; ++i) kill_group(g_batch.groups[i]);
+    groups_clear();
+    return escalated;
+}
@@ -0,0 +1,21 @@
+#ifndef C4A_KILL_H
+#define C4A_KILL_H
+
+#include "c4a_types.h"
+
+// Batched termination. A tick opens one batch, adds every blocked app's pids
+// (each is sent SIGTERM right away) and flushes once: all targets share one
+// grace period, only survivors get SIGKILL, and the flush returns as soon as
+// everything has exited.
+void c4a_kill_begin(void);
+// Signals the set's processes (start times are re-checked to skip recycled
+// pids). Returns the number signalled.
+int c4a_kill_add(const C4aPidSet *set);
+// Adds a cgroup directory: once the batch's own targets are gone or the grace
+// has run out, one write to its cgroup.kill takes down whatever is left in it.
+int c4a_kill_add_group(const char *cgroup_dir);
+// Waits up to grace seconds for the batch, then SIGKILLs what is left.
+// Returns the number of processes that had to be killed.
+int c4a_kill_flush(double grace);
+
+#endif
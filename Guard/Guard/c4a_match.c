@@ -0,0 +1,244 @@
+#include "include.h"
+#include "c4a_match.h"
+
+typedef struct {
+    int child;     // first child, -1 if none
+    int sibling;   // next sibling, -1 if none
+    int fail;      // failure link
+    int dict;      // nearest suffix state that ends a pattern, 0 if none
+    int term;      // head of this state's id list in terms, -1 if none
+    unsigned char ch;
+} AcNode;
+
+typedef struct {
+    int id;
+    int next;
+} AcTerm;
+
+struct C4aMatcher {
+    AcNode *nodes;
+    size_t n, cap;
+    AcTerm *terms;
+    size_t nt, tcap;
+    int root_next[256];
+    unsigned *seen;     // per id scan generation, for once-per-scan reporting
+    size_t seen_len;
+    unsigned gen;
+    int built;
+};
+
+static int ac_new_node(C4aMatcher *m, unsigned char ch) {
+    if (m->n == m->cap) {
+        size_t ncap = m->cap ? m->cap * 2 : 256;
+        AcNode *nn = realloc(m->nodes, ncap * sizeof(AcNode));
+        if (!nn) return -1;
+        m->nodes = nn; m->cap = ncap;
+    }
+    AcNode *nd = &m->nodes[m->n];
+    nd->child = -1; nd->sibling = -1; nd->fail = 0; nd->dict = 0; nd->term = -1; nd->ch = ch;
+    return (int)m->n++;
+}
+
+static int ac_child(const C4aMatcher *m, int s, unsigned char ch) {
+    if (s == 0) return m->root_next[ch];
+    for (int c = m->nodes[s].child; c >= 0; c = m->nodes[c].sibling) {
+        if (m->nodes[c].ch == ch) return c;
+    }
+    return -1;
+}
+
+C4aMatcher *c4a_matcher_new(void) {
+    C4aMatcher *m = calloc(1, sizeof(C4aMatcher));
+    if (!m) return NULL;
+    for (int i = 0; i < 256; ++i) m->root_next[i] = -1;
+    if (ac_new_node(m, 0) != 0) { free(m); return NULL; }
+    return m;
+}
+
+void c4a_matcher_free(C4aMatcher *m) {
+    if (!m) return;
+    free(m->nodes);
+    free(m->terms);
+    free(m->seen);
+    free(m);
+}
+
+int c4a_matcher_add(C4aMatcher *m, const char *lit, size_t len, int id) {
+    if (!m || !lit || len == 0 || id < 0) return -1;
+    int s = 0;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char ch = (unsigned char)lit[i];
+        int nx = ac_child(m, s, ch);
+        if (nx < 0) {
+            nx = ac_new_node(m, ch);
+            if (nx < 0) return -1;
+            if (s == 0) {
+                m->root_next[ch] = nx;
+            }
+            m->nodes[nx].sibling = m->nodes[s].child;
+            m->nodes[s].child = nx;
+        }
+        s = nx;
+    }
+    if (m->nt == m->tcap) {
+        size_t ncap = m->tcap ? m->tcap * 2 : 64;
+        AcTerm *nt = realloc(m->terms, ncap * sizeof(AcTerm));
+        if (!nt) return -1;
+        m->terms = nt; m->tcap = ncap;
+    }
+    m->terms[m->nt].id = id;
+    m->terms[m->nt].next = m->nodes[s].term;
+    m->nodes[s].term = (int)m->nt++;
+    if ((size_t)id >= m->seen_len) {
+        size_t nlen = (size_t)id + 1;
+        unsigned *ns = realloc(m->seen, nlen * sizeof(unsigned));
+        if (!ns) return -1;
+        memset(ns + m->seen_len, 0, (nlen - m->seen_len) * sizeof(unsigned));
+        m->seen = ns; m->seen_len = nlen;
+    }
+    m->built = 0;
+    return 0;
+}
+
+int c4a_matcher_build(C4aMatcher *m) {
+    if (!m) return -1;
+    int *queue = malloc(m->n * sizeof(int));
+    if (!queue) return -1;
+    size_t qh = 0, qt = 0;
+    for (int c = m->nodes[0].child; c >= 0; c = m->nodes[c].sibling) {
+        m->nodes[c].fail = 0;
+        m->nodes[c].dict = 0;
+        queue[qt++] = c;
+    }
+    while (qh < qt) {
+        int u = queue[qh++];
+        for (int v = m->nodes[u].child; v >= 0; v = m->nodes[v].sibling) {
+            unsigned char ch = m->nodes[v].ch;
+            int f = m->nodes[u].fail;
+            int t;
+            while ((t = ac_child(m, f, ch)) < 0 && f != 0) f = m->nodes[f].fail;
+            if (t < 0 || t == v) t = 0;
+            m->nodes[v].fail = t;
+            m->nodes[v].dict = m->nodes[t].term >= 0 ? t : m->nodes[t].dict;
+            queue[qt++] = v;
+        }
+    }
+    free(queue);
+    m->built = 1;
+    return 0;
+}
+
+void c4a_matcher_scan(C4aMatcher *m, const char *text, size_t len, C4aMatchFn fn, void *arg) {
+    if (!m || !m->built || !text) return;
+    if (++m->gen == 0) {
+        // generation counter wrapped; forget stale marks
+        memset(m->seen, 0, m->seen_len * sizeof(unsigned));
+        m->gen = 1;
+    }
+    int s = 0;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char ch = (unsigned char)text[i];
+        int t;
+        while ((t = ac_child(m, s, ch)) < 0 && s != 0) s = m->nodes[s].fail;
+        s = t < 0 ? 0 : t;
+        for (int o = m->nodes[s].term >= 0 ? s : m->nodes[s].dict; o != 0; o = m->nodes[o].dict) {
+            for (int k = m->nodes[o].term; k >= 0; k = m->terms[k].next) {
+                int id = m->terms[k].id;
+                if (m->seen[id] == m->gen) continue;
+                m->seen[id] = m->gen;
+                fn(id, arg);
+            }
+        }
+    }
+}
+
+// Given p at the '[' opening a bracket expression, returns its closing ']'
+// (or the last character when unterminated). A ']' first in the list, and
+// everything inside [:class:], [.coll.] and [=equiv=], is part of it.
+static const char *bracket_end(const char *p) {
+    ++p;
+    if (*p == '^') ++p;
+    if (*p == ']') ++p;
+    while (*p && *p != ']') {
+        if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+            char close = p[1];
+            p += 2;
+            while (*p && !(*p == close && p[1] == ']')) ++p;
+            if (*p) ++p;
+        }
+        if (*p) ++p;
+    }
+    return *p ? p : p - 1;
+}
+
+size_t c4a_regex_required_literal(const char *re, char *out, size_t outlen, int *exact) {
+    if (exact) *exact = 0;
+    if (!re || !out || outlen == 0) return 0;
+    // Top-level or nested alternation means no single literal is required.
+    for (const char *p = re; *p; ++p) {
+        if (*p == '\\' && p[1]) { ++p; continue; }
+        if (*p == '|') return 0;
+    }
+    char run[1024];
+    size_t rlen = 0, best = 0;
+    int plain = 1, depth = 0;
+    out[0] = '\0';
+#define FLUSH_RUN() do { \
+        if (rlen >= outlen) plain = 0; \
+        else if (rlen > best) { memcpy(out, run, rlen); out[rlen] = '\0'; best = rlen; } \
+        rlen = 0; \
+    } while (0)
+    for (const char *p = re; *p; ++p) {
+        char c = *p;
+        if (depth > 0) {
+            // Groups may be optional or repeated; skip their contents.
+            if (c == '\\' && p[1]) { ++p; continue; }
+            if (c == '[') { p = bracket_end(p); continue; }
+            if (c == '(') depth++;
+            else if (c == ')') depth--;
+            continue;
+        }
+        switch (c) {
+        case '(':
+            plain = 0; FLUSH_RUN(); depth = 1; break;
+        case '[':
+            plain = 0; FLUSH_RUN();
+            p = bracket_end(p);
+            break;
+        case '*': case '?':
+            // The previous atom is optional: it cannot be part of the run.
+            plain = 0;
+            if (rlen > 0) rlen--;
+            FLUSH_RUN();
+            break;
+        case '{':
+            plain = 0;
+            if (rlen > 0) rlen--;
+            FLUSH_RUN();
+            while (*p && *p != '}') ++p;
+            if (!*p) { --p; }
+            break;
+        case '+':
+            // At least one occurrence is required, but what follows need not
+            // be adjacent to it.
+            plain = 0; FLUSH_RUN(); break;
+        case '.': case '^': case '$': case ')':
+            plain = 0; FLUSH_RUN(); break;
+        case '\\':
+            if (p[1] == '\0') { plain = 0; FLUSH_RUN(); break; }
+            ++p;
+            // Only an escaped ERE metacharacter is a literal; GNU gives other
+            // escapes (\< \> \b \w \` ...) their own meaning.
+            if (!strchr("\\.[]()*+?{}|^$", *p)) { plain = 0; FLUSH_RUN(); break; }
+            if (rlen < sizeof(run)) run[rlen++] = *p; else plain = 0;
+            break;
+        default:
+            if (rlen < sizeof(run)) run[rlen++] = c; else plain = 0;
+            break;
+        }
+    }
+    FLUSH_RUN();
+#undef FLUSH_RUN
+    if (exact) *exact = plain && best > 0;
+    return best;
+}
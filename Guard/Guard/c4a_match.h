@@ -0,0 +1,26 @@
+#ifndef C4A_MATCH_H
+#define C4A_MATCH_H
+
+#include <stddef.h>
+
+// Aho-Corasick multi-pattern matcher. All literals are compiled into one
+// automaton so a subject string is scanned once regardless of rule count.
+typedef struct C4aMatcher C4aMatcher;
+
+typedef void (*C4aMatchFn)(int id, void *arg);
+
+C4aMatcher *c4a_matcher_new(void);
+void c4a_matcher_free(C4aMatcher *m);
+// Adds a literal; id is reported back on every scan that contains it.
+int c4a_matcher_add(C4aMatcher *m, const char *lit, size_t len, int id);
+// Computes failure links. Must be called after the last add and before scanning.
+int c4a_matcher_build(C4aMatcher *m);
+// Reports each matching id at most once per call.
+void c4a_matcher_scan(C4aMatcher *m, const char *text, size_t len, C4aMatchFn fn, void *arg);
+
+// Extracts the longest run of characters that any match of the extended
+// regular expression re must contain. Sets *exact when re is a plain literal
+// (a hit is then a match). Returns 0 when no safe literal exists.
+size_t c4a_regex_required_literal(const char *re, char *out, size_t outlen, int *exact);
+
+#endif
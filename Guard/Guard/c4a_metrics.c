@@ -0,0 +1,179 @@
+#include "include.h"
+#include "c4a_metrics.h"
+#include "c4a_external.h"
+#include "c4a_types.h"
+#include "c4a_store.h"
+
+#define SUB_BITS 3
+#define SUB (1u << SUB_BITS)
+#define MAGNITUDES 36                 // up to 2^36 us, about 19 hours
+#define BUCKETS (MAGNITUDES * SUB)
+
+typedef struct {
+    uint64_t counts[BUCKETS];
+    uint64_t total;
+    uint64_t sum_us;
+    uint64_t max_us;
+} Hist;
+
+static Hist g_hist[C4A_PHASE_COUNT];
+static uint64_t g_overruns;
+
+static const char *const g_phase_names[C4A_PHASE_COUNT] = {
+    "tick", "enforce", "sample", "detect", "requests", "persist", "commit", "task_start", "kill_flush", "time_sync"
+};
+
+// Values below SUB map 1:1; above, the top SUB_BITS + 1 bits pick the bucket.
+static unsigned bucket_of(uint64_t us) {
+    if (us < SUB) return (unsigned)us;
+    unsigned msb = 63u - (unsigned)__builtin_clzll(us);
+    unsigned shift = msb - SUB_BITS;
+    unsigned b = (shift + 1) * SUB + (unsigned)((us >> shift) & (SUB - 1));
+    return b < BUCKETS ? b : BUCKETS - 1;
+}
+
+// Largest value (exclusive) counted in bucket b.
+static uint64_t bucket_limit(unsigned b) {
+    if (b < SUB) return (uint64_t)b + 1;
+    unsigned shift = b / SUB - 1;
+    return ((uint64_t)(SUB + b % SUB) + 1) << shift;
+}
+
+void c4a_metrics_observe(C4aPhase phase, double seconds) {
+    if ((unsigned)phase >= C4A_PHASE_COUNT) return;
+    uint64_t us = seconds > 0 ? (uint64_t)(seconds * 1e6) : 0;
+    Hist *h = &g_hist[phase];
+    h->counts[bucket_of(us)]++;
+    h->total++;
+    h->sum_us += us;
+    if (us > h->max_us) h->max_us = us;
+}
+
+void c4a_metrics_overrun(void) {
+    g_overruns++;
+}
+
+double c4a_metrics_quantile(C4aPhase phase, double q) {
+    if ((unsigned)phase >= C4A_PHASE_COUNT) return 0.0;
+    const Hist *h = &g_hist[phase];
+    if (h->total == 0) return 0.0;
+    uint64_t rank = (uint64_t)ceil(q * (double)h->total);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < BUCKETS; ++b) {
+        seen += h->counts[b];
+        if (seen >= rank) {
+            uint64_t lim = bucket_limit(b) - 1;
+            return (double)(lim < h->max_us ? lim : h->max_us) / 1e6;
+        }
+    }
+    return (double)h->max_us / 1e6;
+}
+
+static void write_label(FILE *f, const char *s) {
+    for (; *s; ++s) {
+        if (*s == '\\' || *s == '"') fputc('\\', f);
+        if (*s == '\n') { fputs("\\n", f); continue; }
+        fputc(*s, f);
+    }
+}
+
+int c4a_metrics_publish(const char *path) {
+    if (!path) return -1;
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        syslog(LOG_ERR, "metrics: cannot write %s (%d)", tmp, errno);
+        return -1;
+    }
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    fputs("# HELP c4a_phase_duration_seconds Time spent in each phase of the guard loop.\n", f);
+    fputs("# TYPE c4a_phase_duration_seconds histogram\n", f);
+    for (int p = 0; p < C4A_PHASE_COUNT; ++p) {
+        const Hist *h = &g_hist[p];
+        // Prometheus buckets at every other power of two from 16us to 67s;
+        // they fall on histogram bucket edges, so the counts are exact.
+        uint64_t cum = 0;
+        unsigned b = 0;
+        for (unsigned mag = 4; mag <= 26; mag += 2) {
+            uint64_t le = (uint64_t)1 << mag;
+            while (b < BUCKETS && bucket_limit(b) <= le) cum += h->counts[b++];
+            fprintf(f, "c4a_phase_duration_seconds_bucket{phase=\"%s\",le=\"%.9g\"} %llu\n", g_phase_names[p], (double)le / 1e6, (unsigned long long)cum);
+        }
+        fprintf(f, "c4a_phase_duration_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %llu\n", g_phase_names[p], (unsigned long long)h->total);
+        fprintf(f, "c4a_phase_duration_seconds_sum{phase=\"%s\"} %.6f\n", g_phase_names[p], (double)h->sum_us / 1e6);
+        fprintf(f, "c4a_phase_duration_seconds_count{phase=\"%s\"} %llu\n", g_phase_names[p], (unsigned long long)h->total);
+    }
+    fputs("# HELP c4a_phase_duration_quantile_seconds Phase latency quantiles, within 12.5%.\n", f);
+    fputs("# TYPE c4a_phase_duration_quantile_seconds gauge\n", f);
+    for (int p = 0; p < C4A_PHASE_COUNT; ++p) {
+        if (g_hist[p].total == 0) continue;
+        for (size_t k = 0; k < sizeof(quantiles) / sizeof(quantiles[0]); ++k) {
+            fprintf(f, "c4a_phase_duration_quantile_seconds{phase=\"%s\",quantile=\"%g\"} %.6f\n", g_phase_names[p], quantiles[k], c4a_metrics_quantile((C4aPhase)p, quantiles[k]));
+        }
+    }
+    fputs("# HELP c4a_phase_duration_max_seconds Longest time spent in each phase.\n", f);
+    fputs("# TYPE c4a_phase_duration_max_seconds gauge\n", f);
+    for (int p = 0; p < C4A_PHASE_COUNT; ++p) {
+        fprintf(f, "c4a_phase_duration_max_seconds{phase=\"%s\"} %.6f\n", g_phase_names[p], (double)g_hist[p].max_us / 1e6);
+    }
+    fputs("# HELP c4a_tick_overruns_total Periodic ticks that took longer than the cycle.\n", f);
+    fputs("# TYPE c4a_tick_overruns_total counter\n", f);
+    fprintf(f, "c4a_tick_overruns_total %llu\n", (unsigned long long)g_overruns);
+
+    C4aStoreStats ss;
+    c4a_store_stats(&ss);
+    fputs("# HELP c4a_store_sqlite_calls_total SQLite opens, statement prepares and steps behind app memory loads and saves.\n", f);
+    fputs("# TYPE c4a_store_sqlite_calls_total counter\n", f);
+    fprintf(f, "c4a_store_sqlite_calls_total{call=\"open\"} %llu\n", (unsigned long long)ss.opens);
+    fprintf(f, "c4a_store_sqlite_calls_total{call=\"prepare\"} %llu\n", (unsigned long long)ss.prepares);
+    fprintf(f, "c4a_store_sqlite_calls_total{call=\"step\"} %llu\n", (unsigned long long)ss.steps);
+    fputs("# HELP c4a_store_skipped_saves_total App memory saves skipped because nothing changed.\n", f);
+    fputs("# TYPE c4a_store_skipped_saves_total counter\n", f);
+    fprintf(f, "c4a_store_skipped_saves_total %llu\n", (unsigned long long)ss.skipped);
+    fputs("# HELP c4a_store_writer_total Images queued for the memory writer, refused by a full queue, and batches it flushed.\n", f);
+    fputs("# TYPE c4a_store_writer_total counter\n", f);
+    fprintf(f, "c4a_store_writer_total{op=\"queued\"} %llu\n", (unsigned long long)ss.queued);
+    fprintf(f, "c4a_store_writer_total{op=\"queue_full\"} %llu\n", (unsigned long long)ss.queue_full);
+    fprintf(f, "c4a_store_writer_total{op=\"flush\"} %llu\n", (unsigned long long)ss.flushes);
+    fputs("# HELP c4a_store_journal_total Memory journal record appends, syncs and compactions.\n", f);
+    fputs("# TYPE c4a_store_journal_total counter\n", f);
+    fprintf(f, "c4a_store_journal_total{op=\"append\"} %llu\n", (unsigned long long)ss.appends);
+    fprintf(f, "c4a_store_journal_total{op=\"sync\"} %llu\n", (unsigned long long)ss.syncs);
+    fprintf(f, "c4a_store_journal_total{op=\"compact\"} %llu\n", (unsigned long long)ss.compactions);
+
+    C4aExternalStat st[64];
+    size_t n = c4a_external_stats(st, sizeof(st) / sizeof(st[0]));
+    if (n > sizeof(st) / sizeof(st[0])) n = sizeof(st) / sizeof(st[0]);
+    if (n > 0) {
+        static const char *const counters[] = { "runs", "timeouts", "failures" };
+        for (int c = 0; c < 3; ++c) {
+            fprintf(f, "# TYPE c4a_external_probe_%s_total counter\n", counters[c]);
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t v = c == 0 ? st[i].runs : c == 1 ? st[i].timeouts : st[i].failures;
+                fprintf(f, "c4a_external_probe_%s_total{rule=\"", counters[c]);
+                write_label(f, st[i].unique_id);
+                fprintf(f, "\"} %llu\n", (unsigned long long)v);
+            }
+        }
+        fputs("# TYPE c4a_external_probe_seconds gauge\n", f);
+        for (size_t i = 0; i < n; ++i) {
+            const double v[3] = { st[i].last_ms, st[i].avg_ms, st[i].max_ms };
+            static const char *const stat[3] = { "last", "avg", "max" };
+            for (int k = 0; k < 3; ++k) {
+                fputs("c4a_external_probe_seconds{rule=\"", f);
+                write_label(f, st[i].unique_id);
+                fprintf(f, "\",stat=\"%s\"} %.6f\n", stat[k], v[k] / 1e3);
+            }
+        }
+    }
+    int bad = ferror(f);
+    if (fclose(f) != 0) bad = 1;
+    if (bad || rename(tmp, path) != 0) {
+        syslog(LOG_ERR, "metrics: cannot publish %s (%d)", path, errno);
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef C4A_METRICS_H
+#define C4A_METRICS_H
+
+// Latency histograms for the phases of the guard loop. Each phase keeps a
+// log-linear (HDR-style) histogram of microseconds with 8 sub-buckets per
+// power of two, so any recorded value is known to within 12.5%. Recording is
+// a few arithmetic operations; the loop thread is the only writer.
+
+typedef enum {
+    C4A_PHASE_TICK,        // whole periodic tick
+    C4A_PHASE_ENFORCE,     // whole enforcement pass
+    C4A_PHASE_SAMPLE,      // whole usage sample
+    C4A_PHASE_DETECT,
+    C4A_PHASE_REQUESTS,
+    C4A_PHASE_PERSIST,     // one app's memory save
+    C4A_PHASE_COMMIT,      // a pass's store transaction commit (consolidated store)
+    C4A_PHASE_TASK_START,
+    C4A_PHASE_KILL_FLUSH,
+    C4A_PHASE_TIME_SYNC,
+    C4A_PHASE_COUNT
+} C4aPhase;
+
+void c4a_metrics_observe(C4aPhase phase, double seconds);
+// A periodic tick that took longer than its cycle.
+void c4a_metrics_overrun(void);
+// Value at quantile q (0..1) of phase, in seconds; 0 when nothing was recorded.
+double c4a_metrics_quantile(C4aPhase phase, double q);
+// Writes all histograms (and the external probe and store stats) in
+// Prometheus text format to path, through a temporary file and rename.
+// Returns 0 on success.
+int c4a_metrics_publish(const char *path);
+
+#endif
@@ -0,0 +1,140 @@
+#include "include.h"
+#include "c4a_model.h"
+
+// Steps from x with x += d, all adding the same exact amount, that can be
+// taken in one multiplication. Inside one binade of x every representable value
+// is a multiple of the same ulp u, so each sum rounds d to the same multiple
+// of u; on a tie, that holds once x is an even multiple, which the second
+// step confirms. A margin of one ulp at both ends keeps each exact sum inside
+// the binade. Returns 1 when no such run starts at x.
+static uint64_t run_length(double x, double y, double d, uint64_t cap) {
+    if (cap < 2 || !isnormal(x)) return 1;
+    int e;
+    double sign = x < 0 ? -1.0 : 1.0, a = fabs(x);
+    frexp(a, &e);
+    double u = ldexp(1.0, e - 53);
+    double lo = ldexp(1.0, e - 1) + u, hi = ldexp(1.0, e) - u;
+    double a1 = sign * y, a2 = sign * (y + d);
+    if (a1 < lo || a1 > hi || a2 < lo || a2 > hi) return 1;
+    double step = a1 - a;
+    if (a2 - a1 != step) return 1;
+    uint64_t m = (uint64_t)((step > 0 ? hi - a : a - lo) / fabs(step));
+    if (m > cap) m = cap;
+    while (m > 2 && (a + (double)m * step < lo || a + (double)m * step > hi)) m--;
+    while (m < cap && a + (double)(m + 1) * step >= lo && a + (double)(m + 1) * step <= hi) m++;
+    return m;
+}
+
+// Applies up to n steps of *x += d exactly as that many single additions
+// would, stopping after the first step whose result is at or below stop.
+// Returns the steps taken; all n when stop is never reached.
+static uint64_t add_steps(double *x, double d, uint64_t n, double stop) {
+    uint64_t taken = 0;
+    while (taken < n) {
+        double y = *x + d;
+        if (y <= stop) {
+            *x = y;
+            return taken + 1;
+        }
+        // Neither a sum that no longer moves nor an infinity or NaN changes again.
+        if (y == *x || !isfinite(y)) {
+            *x = y;
+            return n;
+        }
+        uint64_t m = run_length(*x, y, d, n - taken);
+        if (m == 1) {
+            *x = y;
+            taken++;
+            continue;
+        }
+        double step = y - *x;
+        if (*x + (double)m * step <= stop) {
+            // Every value in the run is exact, so the crossing is found by comparison.
+            double j = ceil((*x - stop) / -step);
+            uint64_t k = j < 1 ? 1 : j > (double)m ? m : (uint64_t)j;
+            while (k > 1 && *x + (double)(k - 1) * step <= stop) k--;
+            while (*x + (double)k * step > stop) k++;
+            *x += (double)k * step;
+            return taken + k;
+        }
+        *x += (double)m * step;
+        taken += m;
+    }
+    return taken;
+}
+
+static void heat_step(const C4aAppSettings *s, C4aAppMemory *m) {
+    m->current_heat += s->heat;
+    m->last_heat = m->current_heat;
+    m->current_temperature += s->heat_rate + s->sensitivity * (s->heat + m->opens_since_last_cooled);
+}
+
+static void cool_step(const C4aAppSettings *s, C4aAppMemory *m) {
+    if (m->cooled) return;
+    double nt = m->current_temperature - s->cool_rate;
+    if (nt < s->starting_temperature) nt = s->starting_temperature;
+    m->current_temperature = nt;
+    if (nt == s->starting_temperature && m->opens_since_last_cooled > 0) {
+        m->opens_since_last_cooled -= 1;
+        if (m->opens_since_last_cooled == 0) m->cooled = 1;
+    }
+}
+
+// Step (1-based) on which an idle app first lands on starting_temperature.
+static uint64_t steps_to_floor(const C4aAppSettings *s, const C4aAppMemory *m) {
+    double t = m->current_temperature;
+    uint64_t k = add_steps(&t, -s->cool_rate, UINT64_MAX, s->starting_temperature);
+    return t <= s->starting_temperature ? k : UINT64_MAX;
+}
+
+void c4a_model_advance(const C4aAppSettings *s, C4aAppMemory *m, int running, uint64_t steps) {
+    if (!s || !m || steps == 0) return;
+    if (steps == 1) {
+        if (running) heat_step(s, m);
+        else cool_step(s, m);
+        return;
+    }
+    if (running) {
+        // Every running step adds the same amounts: opens does not change.
+        add_steps(&m->current_heat, s->heat, steps, -INFINITY);
+        m->last_heat = m->current_heat;
+        add_steps(&m->current_temperature, s->heat_rate + s->sensitivity * (s->heat + m->opens_since_last_cooled), steps, -INFINITY);
+        return;
+    }
+    if (m->cooled) return;
+    if (s->cool_rate <= 0) {
+        // Temperature never falls toward the floor; no closed form worth having.
+        for (uint64_t i = 0; i < steps && !m->cooled; ++i) cool_step(s, m);
+        return;
+    }
+    uint64_t k = steps_to_floor(s, m);
+    if (steps < k) {
+        add_steps(&m->current_temperature, -s->cool_rate, steps, -INFINITY);
+        return;
+    }
+    m->current_temperature = s->starting_temperature;
+    // Steps k..steps each spend one open.
+    uint64_t spend = steps - k + 1;
+    if (m->opens_since_last_cooled > 0) {
+        if ((uint64_t)m->opens_since_last_cooled <= spend) {
+            m->opens_since_last_cooled = 0;
+            m->cooled = 1;
+        } else {
+            m->opens_since_last_cooled -= (int64_t)spend;
+        }
+    }
+}
+
+uint64_t c4a_model_steps_until_cooled(const C4aAppSettings *s, const C4aAppMemory *m) {
+    if (!s || !m) return UINT64_MAX;
+    if (m->cooled) return 0;
+    if (m->opens_since_last_cooled <= 0) return UINT64_MAX;
+    if (s->cool_rate <= 0) {
+        // Without cooling the floor is only reached when already at or below it.
+        if (m->current_temperature - s->cool_rate <= s->starting_temperature) return (uint64_t)m->opens_since_last_cooled;
+        return UINT64_MAX;
+    }
+    uint64_t k = steps_to_floor(s, m);
+    if (k == UINT64_MAX) return UINT64_MAX;
+    return k + (uint64_t)m->opens_since_last_cooled - 1;
+}
@@ -0,0 +1,21 @@
+#ifndef C4A_MODEL_H
+#define C4A_MODEL_H
+
+#include <stdint.h>
+#include "c4a_types.h"
+
+// The temperature model, one step per cycle:
+//   running: current_heat += heat; last_heat = current_heat;
+//            temperature += heat_rate + sensitivity * (heat + opens_since_last_cooled)
+//   idle, not cooled: temperature -= cool_rate, clamped at starting_temperature;
+//            every step that ends at starting_temperature spends one of
+//            opens_since_last_cooled, and spending the last sets cooled.
+// c4a_model_advance applies any number of steps in one go. A single step is the
+// literal rule above; longer runs add the per-step amounts a binade at a time
+// and settle the opens spent at the floor in closed form, reaching bit for bit
+// what repeated single steps reach, heating or cooling.
+void c4a_model_advance(const C4aAppSettings *s, C4aAppMemory *m, int running, uint64_t steps);
+// Idle steps until cooled becomes 1, 0 if already cooled, UINT64_MAX if never.
+uint64_t c4a_model_steps_until_cooled(const C4aAppSettings *s, const C4aAppMemory *m);
+
+#endif
@@ -0,0 +1,126 @@
+#include "include.h"
+#include "c4a_types.h"
+#include "c4a_procev.h"
+#include "detection.h"
+#include "c4a_trace.h"
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+
+static int g_fd = -1;
+
+static int send_mcast_op(int fd, enum proc_cn_mcast_op op) {
+    char buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))];
+    memset(buf, 0, sizeof(buf));
+    struct nlmsghdr *nh = (struct nlmsghdr *)buf;
+    nh->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(op));
+    nh->nlmsg_type = NLMSG_DONE;
+    nh->nlmsg_pid = (uint32_t)getpid();
+    struct cn_msg *cn = (struct cn_msg *)NLMSG_DATA(nh);
+    cn->id.idx = CN_IDX_PROC;
+    cn->id.val = CN_VAL_PROC;
+    cn->len = sizeof(op);
+    memcpy(cn->data, &op, sizeof(op));
+    return send(fd, nh, nh->nlmsg_len, 0) == (ssize_t)nh->nlmsg_len ? 0 : -1;
+}
+
+int c4a_procev_open(void) {
+    if (g_fd >= 0) return 0;
+    int fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (fd < 0) {
+        syslog(LOG_NOTICE, "proc connector unavailable (%d); polling detection", errno);
+        return -1;
+    }
+    struct sockaddr_nl sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    sa.nl_groups = CN_IDX_PROC;
+    sa.nl_pid = 0; // let the kernel assign a port id
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || send_mcast_op(fd, PROC_CN_MCAST_LISTEN) != 0) {
+        syslog(LOG_NOTICE, "proc connector subscribe failed (%d); polling detection", errno);
+        close(fd);
+        return -1;
+    }
+    g_fd = fd;
+    c4a_detect_set_live(1);
+    syslog(LOG_NOTICE, "proc connector active; event-driven detection");
+    return 0;
+}
+
+void c4a_procev_close(void) {
+    if (g_fd < 0) return;
+    send_mcast_op(g_fd, PROC_CN_MCAST_IGNORE);
+    close(g_fd);
+    g_fd = -1;
+    c4a_detect_set_live(0);
+}
+
+int c4a_procev_fd(void) {
+    return g_fd;
+}
+
+int c4a_procev_drain(C4aContext *ctx) {
+    if (g_fd < 0) return -1;
+    int due = 0;
+    for (;;) {
+        char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+        ssize_t n = recv(g_fd, buf, sizeof(buf), 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == ENOBUFS) {
+                // Events were dropped; the live map can no longer be trusted.
+                syslog(LOG_WARNING, "proc connector overrun; rescanning /proc");
+                c4a_detect_request_rescan();
+                continue;
+            }
+            syslog(LOG_WARNING, "proc connector recv failed (%d); falling back to polling", errno);
+            c4a_procev_close();
+            return -1;
+        }
+        if (n == 0) break;
+        for (struct nlmsghdr *nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (size_t)n); nh = NLMSG_NEXT(nh, n)) {
+            if (nh->nlmsg_type == NLMSG_ERROR || nh->nlmsg_type == NLMSG_NOOP) continue;
+            struct cn_msg *cn = (struct cn_msg *)NLMSG_DATA(nh);
+            if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC) continue;
+            struct proc_event *ev = (struct proc_event *)cn->data;
+            switch (ev->what) {
+            case PROC_EVENT_EXEC:
+                if (ev->event_data.exec.process_pid == ev->event_data.exec.process_tgid &&
+                    c4a_detect_note_exec(ctx, ev->event_data.exec.process_tgid)) {
+                    c4a_trace(C4A_TR_PROC_EVENT, -1, ev->event_data.exec.process_tgid, 1);
+                    due = 1;
+                }
+                break;
+            case PROC_EVENT_FORK:
+                // Only new processes; threads share their leader's identity.
+                if (ev->event_data.fork.child_pid == ev->event_data.fork.child_tgid &&
+                    c4a_detect_note_fork(ctx, ev->event_data.fork.parent_tgid, ev->event_data.fork.child_tgid)) {
+                    c4a_trace(C4A_TR_PROC_EVENT, -1, ev->event_data.fork.child_tgid, 2);
+                    due = 1;
+                }
+                break;
+            case PROC_EVENT_EXIT:
+                if (ev->event_data.exit.process_pid == ev->event_data.exit.process_tgid) {
+                    c4a_detect_note_exit(ctx, ev->event_data.exit.process_tgid);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    return due;
+}
+
+#else
+
+int c4a_procev_open(void) { return -1; }
+void c4a_procev_close(void) {}
+int c4a_procev_fd(void) { return -1; }
+int c4a_procev_drain(C4aContext *ctx) { (void)ctx; return -1; }
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef C4A_PROCEV_H
+#define C4A_PROCEV_H
+
+#include "c4a_types.h"
+
+// Process event source backed by the Linux netlink proc connector
+// (PROC_EVENT_EXEC/FORK/EXIT). When it is active, detection keeps a live
+// pid->app map and the daemon can react to a launch within milliseconds.
+// Elsewhere, or without CAP_NET_ADMIN, open fails and polling stays in charge.
+
+// Subscribes to process events. Returns 0 when the connector is active.
+int c4a_procev_open(void);
+void c4a_procev_close(void);
+// Readable descriptor to wait on, or -1 when the connector is not active.
+int c4a_procev_fd(void);
+// Applies all pending events to ctx. Returns 1 if a newly started process
+// belongs to an app that needs enforcement, 0 otherwise, -1 on error.
+int c4a_procev_drain(C4aContext *ctx);
+
+#endif
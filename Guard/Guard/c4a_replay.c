@@ -0,0 +1,208 @@
+#include "include.h"
+#include "c4a_types.h"
+#include "c4a_replay.h"
+#include "c4a_trace.h"
+#include "c4a_clock.h"
+#include "c4a_store.h"
+#include "c4a_requests.h"
+#include "c4a_metrics.h"
+#include "c4a_time.h"
+#include "guard_tick.h"
+#include "tasks.h"
+
+// Stand-in pids for running apps; above any pid_max, so they never name a
+// real process.
+#define REPLAY_PID_BASE 0x7fff0000
+
+typedef struct {
+    uint64_t allowed, burned, challenges;
+} Decisions;
+
+static int add_default_app(C4aContext *ctx) {
+    C4aApp **napps = realloc(ctx->apps, (ctx->app_count + 1) * sizeof(C4aApp*));
+    if (!napps) return -1;
+    ctx->apps = napps;
+    C4aApp *app = calloc(1, sizeof(C4aApp));
+    if (!app) return -1;
+    char uid[32];
+    snprintf(uid, sizeof(uid), "replay.%zu", ctx->app_count);
+    app->settings.unique_id = strdup(uid);
+    app->settings.display_name = strdup(uid);
+    app->settings.trigger_id_type = strdup("name");
+    app->settings.trigger_id_data = strdup(uid);
+    app->settings.starting_temperature = 1.0;
+    app->settings.heat_rate = 1.0;
+    app->settings.cool_rate = 1.0;
+    app->memory.current_temperature = 1.0;
+    app->memory.cooled = 1;
+    ctx->apps[ctx->app_count++] = app;
+    return 0;
+}
+
+static void set_running(C4aApp *app, size_t i, int running) {
+    app->pids.len = 0;
+    if (running) c4a_pidset_push(&app->pids, (pid_t)(REPLAY_PID_BASE + i), 0);
+    app->is_running = running;
+}
+
+// Puts app back in the state it had at the checkpoint.
+static void apply_image(C4aApp *app, size_t i, const C4aTraceImage *im, double epoch) {
+    C4aAppMemory *m = &app->memory;
+    m->current_temperature = im->temperature;
+    m->current_heat = im->heat;
+    m->last_heat = im->last_heat;
+    m->hours_remaining_until_not_burned = im->hours_remaining;
+    m->opens_since_last_cooled = im->opens_since_last_cooled;
+    m->lifetime_opens = im->lifetime_opens;
+    m->lifetime_numbr_of_times_burned = im->times_burned;
+    m->cooled = im->cooled;
+    m->burned = im->burned;
+    m->burned_forever = im->burned_forever;
+    char buf[32];
+    free(m->date_time_of_last_free_open);
+    m->date_time_of_last_free_open = NULL;
+    if (im->last_free_open > 0) {
+        snprintf(buf, sizeof(buf), "%.0f", im->last_free_open);
+        m->date_time_of_last_free_open = strdup(buf);
+    }
+    // Only whether it is set matters to the tick.
+    free(m->last_open_time);
+    m->last_open_time = NULL;
+    if (im->opened) {
+        time_t t = (time_t)epoch;
+        struct tm tmv;
+        strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", localtime_r(&t, &tmv));
+        m->last_open_time = strdup(buf);
+    }
+    app->allowed = im->allowed;
+    app->allowed_since_mono = im->allowed_since;
+    app->last_burn_check_mono = im->last_burn_check;
+    app->last_warn_mono = im->last_warn;
+    app->next_step_mono = im->next_step;
+    app->last_running = im->last_running;
+    app->samples = im->samples;
+    app->samples_running = im->samples_running;
+    set_running(app, i, im->running);
+}
+
+// Runs one pass and counts the decisions it made.
+static void replay_pass(C4aContext *ctx, int full, Decisions *d) {
+    size_t n = ctx->app_count;
+    int before[n][3];
+    for (size_t i = 0; i < n; ++i) {
+        const C4aApp *app = ctx->apps[i];
+        before[i][0] = app->allowed;
+        before[i][1] = app->memory.burned;
+        before[i][2] = app->task.state;
+    }
+    if (full) guard_tick(ctx);
+    else guard_tick_enforce(ctx);
+    for (size_t i = 0; i < n; ++i) {
+        const C4aApp *app = ctx->apps[i];
+        if (app->allowed && !before[i][0]) d->allowed++;
+        if (app->memory.burned && !before[i][1]) d->burned++;
+        if (app->task.state == C4A_TASK_RUNNING && before[i][2] != C4A_TASK_RUNNING) d->challenges++;
+    }
+}
+
+static void print_latency(const char *what, C4aPhase phase, uint64_t count) {
+    printf("%-8s %8llu passes  p50 %9.1fus  p90 %9.1fus  p99 %9.1fus  max %9.1fus\n", what, (unsigned long long)count,
+           c4a_metrics_quantile(phase, 0.5) * 1e6, c4a_metrics_quantile(phase, 0.9) * 1e6,
+           c4a_metrics_quantile(phase, 0.99) * 1e6, c4a_metrics_quantile(phase, 1.0) * 1e6);
+}
+
+int c4a_replay_main(const char *path) {
+    C4aTraceHeader h;
+    size_t n = 0;
+    C4aTraceRec *recs = c4a_trace_load(path, &h, &n);
+    if (!recs) return 1;
+    if (n == 0) { fprintf(stderr, "%s: no events\n", path); free(recs); return 1; }
+
+    // The replay starts where the recorded guard's state is known.
+    C4aTraceState *st = malloc(sizeof(*st));
+    if (!st || c4a_trace_load_state(path, recs[0].seq, st) != 0) {
+        fprintf(stderr, "%s: no app state checkpoint covers the recording; cannot replay it\n", path);
+        free(st); free(recs);
+        return 1;
+    }
+    size_t k0 = 0;
+    while (k0 < n && recs[k0].seq < st->seq) k0++;
+
+    C4aContext *ctx = c4a_context_new();
+    if (!ctx) { free(st); free(recs); return 1; }
+    ctx->simulated = 1;
+    c4a_bootstrap(ctx);
+    int64_t need = st->total;
+    for (size_t k = k0; k < n; ++k) if ((int64_t)recs[k].app + 1 > need) need = (int64_t)recs[k].app + 1;
+    while ((int64_t)ctx->app_count < need) {
+        if (add_default_app(ctx) != 0) { c4a_free_context(ctx); free(st); free(recs); return 1; }
+    }
+    double epoch0 = h.epoch - (h.mono - st->mono);
+    for (size_t i = 0; i < st->napps; ++i) apply_image(ctx->apps[i], i, &st->apps[i], epoch0);
+    if (st->napps < st->total) {
+        fprintf(stderr, "%s: apps %u..%u were not checkpointed; their memory comes from the files\n", path, st->napps, st->total - 1);
+    }
+    C4aVirtualClock vc;
+    c4a_clock_virtual_init(&vc, st->mono, epoch0);
+    ctx->clock = &vc.base;
+    free(st);
+
+    Decisions recorded = { 0, 0, 0 }, replayed = { 0, 0, 0 };
+    uint64_t ticks = 0, passes = 0, requests = 0;
+    double t0 = c4a_mono_now();
+    for (size_t k = k0; k < n; ++k) {
+        const C4aTraceRec *r = &recs[k];
+        c4a_clock_virtual_advance(&vc, r->mono - vc.mono);
+        C4aApp *app = r->app >= 0 && (size_t)r->app < ctx->app_count ? ctx->apps[r->app] : NULL;
+        switch (r->type) {
+        case C4A_TR_DETECT:
+            if (app) set_running(app, (size_t)r->app, r->b != 0);
+            break;
+        case C4A_TR_RUNNING:
+            if (app) set_running(app, (size_t)r->app, r->a != 0);
+            break;
+        case C4A_TR_REQUEST:
+            c4a_apply_request(ctx, app, (C4aRequestType)r->b, (double)r->a / 1000.0);
+            requests++;
+            break;
+        case C4A_TR_TASK_EXIT:
+            if (app && app->task.state == C4A_TASK_RUNNING) c4a_task_finish(app, r->b == 1, r->b < 0);
+            break;
+        case C4A_TR_TICK:
+            replay_pass(ctx, r->a != 0, &replayed);
+            if (r->a) ticks++; else passes++;
+            break;
+        case C4A_TR_ALLOWED:
+            if (r->a) recorded.allowed++;
+            break;
+        case C4A_TR_BURNED:
+            recorded.burned++;
+            break;
+        case C4A_TR_TASK_START:
+            recorded.challenges++;
+            break;
+        default:
+            break;
+        }
+    }
+    double took = c4a_mono_now() - t0;
+
+    printf("replayed %zu events (%.1f s of recording) in %.3f s: %llu ticks, %llu enforcement passes, %llu requests\n",
+           n - k0, k0 < n ? recs[n - 1].mono - recs[k0].mono : 0.0, took, (unsigned long long)ticks, (unsigned long long)passes, (unsigned long long)requests);
+    print_latency("tick", C4A_PHASE_TICK, ticks);
+    print_latency("enforce", C4A_PHASE_ENFORCE, passes);
+    printf("%-12s %10s %10s\n", "decisions", "recorded", "replayed");
+    printf("%-12s %10llu %10llu\n", "allowed", (unsigned long long)recorded.allowed, (unsigned long long)replayed.allowed);
+    printf("%-12s %10llu %10llu\n", "burned", (unsigned long long)recorded.burned, (unsigned long long)replayed.burned);
+    printf("%-12s %10llu %10llu\n", "challenges", (unsigned long long)recorded.challenges, (unsigned long long)replayed.challenges);
+    for (size_t i = 0; i < ctx->app_count; ++i) {
+        const C4aApp *app = ctx->apps[i];
+        const C4aAppMemory *m = &app->memory;
+        printf("app %zu %s: temperature=%.6f heat=%.6f opens_since_last_cooled=%lld cooled=%d burned=%d burned_forever=%d hours_remaining=%.6f lifetime_opens=%lld allowed=%d\n",
+               i, app->settings.unique_id ?: "", m->current_temperature, m->current_heat, (long long)m->opens_since_last_cooled,
+               m->cooled, m->burned, m->burned_forever, m->hours_remaining_until_not_burned, (long long)m->lifetime_opens, app->allowed);
+    }
+    c4a_free_context(ctx);
+    free(recs);
+    return 0;
+}
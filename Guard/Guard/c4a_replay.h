@@ -0,0 +1,20 @@
+#ifndef C4A_REPLAY_H
+#define C4A_REPLAY_H
+
+// `Guard --replay trace.bin`: feeds a trace dump (c4a_trace.h) back through
+// the real tick under a virtual clock (c4a_clock.h). Detection results,
+// process starts and stops, requests and challenge results come from the
+// recording; ticks and enforcement passes run at their recorded times in a
+// simulated context, so nothing is signalled, launched, written or run.
+// Settings are read from the daemon's files, opened read-only; apps the
+// recording mentions beyond those get default settings. The replay starts at
+// the oldest app state checkpoint of the dump that no surviving event
+// predates, from the memory and runtime state recorded there; a dump without
+// one is refused.
+//
+// Prints tick and enforcement latency percentiles, the decisions the replay
+// made next to the recorded ones, and every app's final memory, so two builds
+// can be compared on the same recording.
+int c4a_replay_main(const char *path);
+
+#endif
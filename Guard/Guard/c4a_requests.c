@@ -1,6 +1,7 @@
 #include "include.h"
 #include "c4a_types.h"
 #include "c4a_requests.h"
+#include "c4a_trace.h"
 #include <sqlite3.h>
 
 static C4aApp *find_app_by_uid(C4aContext *ctx, const char *uid) {
@@ -12,6 +13,12 @@ static C4aApp *find_app_by_uid(C4aContext *ctx, const char *uid) {
     return NULL;
 }
 
+C4aRequestType c4a_request_type(const char *name) {
+    static const char *const types[] = { "upgrade_permanent", "extend_burn", "burn", "increase_temp" };
+    for (int k = 0; name && k < 4; ++k) if (strcmp(name, types[k]) == 0) return (C4aRequestType)(k + 1);
+    return C4A_REQ_OTHER;
+}
+
 static void reward_all_others(C4aContext *ctx, C4aApp *target, double delta) {
     if (!ctx) return;
     for (size_t i = 0; i < ctx->app_count; ++i) {
@@ -35,6 +42,43 @@ static void ensure_requests_schema(sqlite3 *db) {
     sqlite3_exec(db, sql, NULL, NULL, NULL);
 }
 
+void c4a_apply_request(C4aContext *ctx, C4aApp *app, C4aRequestType type, double val) {
+    int32_t idx = -1;
+    for (size_t i = 0; app && i < ctx->app_count; ++i) if (ctx->apps[i] == app) idx = (int32_t)i;
+    c4a_trace(C4A_TR_REQUEST, idx, (int64_t)(val * 1000.0), type);
+    if (!app) return;
+    switch (type) {
+    case C4A_REQ_UPGRADE_PERMANENT:
+        app->memory.burned = 1;
+        app->memory.burned_forever = 1;
+        reward_all_others(ctx, app, ctx->globals.permanent_burn_reward > 0 ? ctx->globals.permanent_burn_reward : 0.5);
+        break;
+    case C4A_REQ_EXTEND_BURN: {
+        if (val < 0) val = 0;
+        app->memory.hours_remaining_until_not_burned += val;
+        double rr = ctx->globals.extend_burn_reward_per_hour > 0 ? ctx->globals.extend_burn_reward_per_hour : 0.005;
+        reward_all_others(ctx, app, rr * val);
+        break;
+    }
+    case C4A_REQ_BURN: {
+        app->memory.burned = 1;
+        if (val > 0) app->memory.hours_remaining_until_not_burned = val;
+        // Reward small
+        double rr = ctx->globals.temp_increase_reward_ratio > 0 ? ctx->globals.temp_increase_reward_ratio : 0.05;
+        reward_all_others(ctx, app, rr);
+        break;
+    }
+    case C4A_REQ_INCREASE_TEMP: {
+        if (val > 0) app->memory.current_temperature += val;
+        double rr = ctx->globals.temp_increase_reward_ratio > 0 ? ctx->globals.temp_increase_reward_ratio : 0.05;
+        reward_all_others(ctx, app, rr * val);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
 int c4a_process_requests(C4aContext *ctx) {
     sqlite3 *db = NULL;
     if (sqlite3_open(REQUESTS_DB_PATH, &db) != SQLITE_OK) {
@@ -50,34 +94,7 @@ int c4a_process_requests(C4aContext *ctx) {
         const char *uid = (const char*)sqlite3_column_text(st, 2);
         double val = sqlite3_column_double(st, 3);
         C4aApp *app = uid ? find_app_by_uid(ctx, uid) : NULL;
-        if (typ && strcmp(typ, "upgrade_permanent") == 0) {
-            if (app) {
-                app->memory.burned = 1;
-                app->memory.burned_forever = 1;
-                reward_all_others(ctx, app, ctx->globals.permanent_burn_reward > 0 ? ctx->globals.permanent_burn_reward : 0.5);
-            }
-        } else if (typ && strcmp(typ, "extend_burn") == 0) {
-            if (app) {
-                if (val < 0) val = 0;
-                app->memory.hours_remaining_until_not_burned += val;
-                double rr = ctx->globals.extend_burn_reward_per_hour > 0 ? ctx->globals.extend_burn_reward_per_hour : 0.005;
-                reward_all_others(ctx, app, rr * val);
-            }
-        } else if (typ && strcmp(typ, "burn") == 0) {
-            if (app) {
-                app->memory.burned = 1;
-                if (val > 0) app->memory.hours_remaining_until_not_burned = val;
-                // Reward small
-                double rr = ctx->globals.temp_increase_reward_ratio > 0 ? ctx->globals.temp_increase_reward_ratio : 0.05;
-                reward_all_others(ctx, app, rr);
-            }
-        } else if (typ && strcmp(typ, "increase_temp") == 0) {
-            if (app) {
-                if (val > 0) app->memory.current_temperature += val;
-                double rr = ctx->globals.temp_increase_reward_ratio > 0 ? ctx->globals.temp_increase_reward_ratio : 0.05;
-                reward_all_others(ctx, app, rr * val);
-            }
-        }
+        c4a_apply_request(ctx, app, c4a_request_type(typ), val);
         // Delete processed row
         char delsql[128]; snprintf(delsql, sizeof(delsql), "DELETE FROM requests WHERE id=%d", rid);
         sqlite3_exec(db, delsql, NULL, NULL, NULL);
@@ -86,3 +103,28 @@ int c4a_process_requests(C4aContext *ctx) {
     sqlite3_close(db);
     return 0;
 }
+
+// Kept open between calls: an idle wait may ask on every event in the
+// request database's directory, including those from the tick's own pass.
+static struct {
+    sqlite3 *db;
+    sqlite3_stmt *st;
+} g_pending;
+
+int c4a_requests_pending(void) {
+    if (!g_pending.st) {
+        if (sqlite3_open_v2(REQUESTS_DB_PATH, &g_pending.db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK ||
+            sqlite3_prepare_v2(g_pending.db, "SELECT EXISTS (SELECT 1 FROM requests)", -1, &g_pending.st, NULL) != SQLITE_OK) {
+            // Not created yet, or no table: nothing can be queued.
+            sqlite3_close(g_pending.db);
+            g_pending.db = NULL;
+            g_pending.st = NULL;
+            return 0;
+        }
+    }
+    int rc = sqlite3_step(g_pending.st);
+    int pending = rc == SQLITE_ROW && sqlite3_column_int(g_pending.st, 0) != 0;
+    sqlite3_reset(g_pending.st);
+    // Busy while a writer holds the lock: a request is on its way.
+    return pending || rc == SQLITE_BUSY;
+}
@@ -3,7 +3,24 @@
 
 #include "c4a_types.h"
 
+// Request types; the numbers appear in trace records (c4a_trace.h).
+typedef enum {
+    C4A_REQ_OTHER,
+    C4A_REQ_UPGRADE_PERMANENT,
+    C4A_REQ_EXTEND_BURN,
+    C4A_REQ_BURN,
+    C4A_REQ_INCREASE_TEMP
+} C4aRequestType;
+
+C4aRequestType c4a_request_type(const char *name);
+// Applies one request to app (NULL when no app matched) and traces it.
+void c4a_apply_request(C4aContext *ctx, C4aApp *app, C4aRequestType type, double val);
+// Applies and deletes every queued row of REQUESTS_DB_PATH.
 int c4a_process_requests(C4aContext *ctx);
+// Whether REQUESTS_DB_PATH holds rows not yet processed. Tells a real request
+// from the guard's own reads and deletes, which the directory watch
+// (c4a_exit_requests_changed) sees too.
+int c4a_requests_pending(void);
 
 #endif
 
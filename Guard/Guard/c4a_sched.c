@@ -0,0 +1,86 @@
+#include "include.h"
+#include "c4a_sched.h"
+
+typedef struct {
+    double at;
+    size_t app;
+} C4aDeadline;
+
+static struct {
+    C4aDeadline *heap;
+    size_t len;
+    size_t *pos;     // app -> heap slot, (size_t)-1 when absent
+    size_t napps;
+} g_sched;
+
+#define NOPOS ((size_t)-1)
+
+static void swap_slots(size_t a, size_t b) {
+    C4aDeadline t = g_sched.heap[a];
+    g_sched.heap[a] = g_sched.heap[b];
+    g_sched.heap[b] = t;
+    g_sched.pos[g_sched.heap[a].app] = a;
+    g_sched.pos[g_sched.heap[b].app] = b;
+}
+
+static void sift_up(size_t i) {
+    while (i > 0) {
+        size_t p = (i - 1) / 2;
+        if (g_sched.heap[p].at <= g_sched.heap[i].at) break;
+        swap_slots(i, p);
+        i = p;
+    }
+}
+
+static void sift_down(size_t i) {
+    for (;;) {
+        size_t l = 2 * i + 1, r = l + 1, m = i;
+        if (l < g_sched.len && g_sched.heap[l].at < g_sched.heap[m].at) m = l;
+        if (r < g_sched.len && g_sched.heap[r].at < g_sched.heap[m].at) m = r;
+        if (m == i) break;
+        swap_slots(i, m);
+        i = m;
+    }
+}
+
+void c4a_sched_reset(size_t app_count) {
+    g_sched.len = 0;
+    if (app_count != g_sched.napps) {
+        C4aDeadline *h = realloc(g_sched.heap, (app_count ? app_count : 1) * sizeof(C4aDeadline));
+        size_t *p = realloc(g_sched.pos, (app_count ? app_count : 1) * sizeof(size_t));
+        if (h) g_sched.heap = h;
+        if (p) g_sched.pos = p;
+        g_sched.napps = (h && p) ? app_count : 0;
+    }
+    for (size_t i = 0; i < g_sched.napps; ++i) g_sched.pos[i] = NOPOS;
+}
+
+void c4a_sched_update(size_t app, double deadline) {
+    if (app >= g_sched.napps) return;
+    size_t i = g_sched.pos[app];
+    if (deadline <= 0) {
+        if (i == NOPOS) return;
+        g_sched.len--;
+        if (i != g_sched.len) {
+            swap_slots(i, g_sched.len);
+            sift_up(i);
+            sift_down(i);
+        }
+        g_sched.pos[app] = NOPOS;
+        return;
+    }
+    if (i == NOPOS) {
+        i = g_sched.len++;
+        g_sched.heap[i].app = app;
+        g_sched.pos[app] = i;
+    }
+    g_sched.heap[i].at = deadline;
+    sift_up(i);
+    sift_down(g_sched.pos[app]);
+}
+
+double c4a_sched_next(size_t *app) {
+    if (g_sched.len == 0) return 0.0;
+    if (app) *app = g_sched.heap[0].app;
+    return g_sched.heap[0].at;
+}
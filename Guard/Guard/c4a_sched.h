@@ -0,0 +1,18 @@
+#ifndef C4A_SCHED_H
+#define C4A_SCHED_H
+
+#include <stddef.h>
+
+// Per-app deadline heap for the tickless loop. Each app (by index in
+// ctx->apps) has at most one entry: the monotonic time at which its state
+// would next change without an outside event. The daemon sleeps until the
+// earliest one.
+
+// Drops every entry and sizes the heap for app_count apps.
+void c4a_sched_reset(size_t app_count);
+// Sets app's deadline; a deadline <= 0 removes the entry.
+void c4a_sched_update(size_t app, double deadline);
+// Earliest deadline (and its app when app is not NULL), or 0 when empty.
+double c4a_sched_next(size_t *app);
+
+#endif
@@ -2,6 +2,9 @@
 #include "c4a_types.h"
 #include "c4a_store.h"
 #include "error.h"
+#include "detection.h"
+#include "c4a_journal.h"
+#include "c4a_time.h"
 #include <sqlite3.h>
 
 static char *path_join2(const char *a, const char *b) {
@@ -43,9 +46,11 @@ static void set_default_globals(C4aGlobalSettings *g) {
     g->failed_multiplyer = 1.5;
 }
 
-static int load_globals_from_db(const char *db_path, C4aGlobalSettings *out) {
+// readonly opens an existing database as is: no table or default row is
+// created.
+static int load_globals_from_db(const char *db_path, C4aGlobalSettings *out, int readonly) {
     sqlite3 *db = NULL;
-    int rc = sqlite3_open(db_path, &db);
+    int rc = readonly ? sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READONLY, NULL) : sqlite3_open(db_path, &db);
     if (rc != SQLITE_OK) {
         syslog(LOG_ERR, "global open failed: %s", sqlite3_errmsg(db));
         if (db) sqlite3_close(db);
@@ -68,7 +73,7 @@ static int load_globals_from_db(const char *db_path, C4aGlobalSettings *out) {
         "permanent_burn_reward FLOAT NOT NULL DEFAULT 0.5,"
         "extend_burn_reward_per_hour FLOAT NOT NULL DEFAULT 0.005,"
         "temp_increase_reward_ratio FLOAT NOT NULL DEFAULT 0.05);";
-    rc = sqlite3_exec(db, create_sql, NULL, NULL, NULL);
+    rc = readonly ? SQLITE_OK : sqlite3_exec(db, create_sql, NULL, NULL, NULL);
     if (rc != SQLITE_OK) {
         syslog(LOG_ERR, "global create failed: %d", rc);
         sqlite3_close(db);
@@ -81,7 +86,7 @@ static int load_globals_from_db(const char *db_path, C4aGlobalSettings *out) {
     int have = 0;
     if (sqlite3_step(st) == SQLITE_ROW) { have = sqlite3_column_int(st, 0); }
     sqlite3_finalize(st);
-    if (have == 0) {
+    if (have == 0 && !readonly) {
     const char *ins =
             "INSERT INTO globsl_settings (cycle_frequency_in_seconds,final_multiplier,globaltemp,can_fail_tasks,grade_tasks,min_grade_to_pass,ambient_temp,early_exit_enforment,early_exit_multiplyer,failed_multiplyer,burn_warning_ratio,permanent_burn_reward,extend_burn_reward_per_hour,temp_increase_reward_ratio)"
             " VALUES (60,1.05,1.0,1,1,0.95,1.0,1,10.0,1.5,0.9,0.5,0.005,0.05)";
@@ -117,17 +122,20 @@ static int load_globals_from_db(const char *db_path, C4aGlobalSettings *out) {
     return 0;
 }
 
-static int load_app_rows(sqlite3 *db, const char *group_key, C4aContext *ctx) {
-    const char *sel =
-        "SELECT unique_id,display_name,trigger_id_type,trigger_id_data,"
-        "always_blocked,always_discouraged,sensitivity,starting_temperature,heat_rate,cool_rate,"
-        "seconds_of_usage_before_new_task,temperature_refresh_interval_in_seconds,heat,"
-        "task_maths_available,task_lines_available,task_clicks_available,task_count_available,"
+#define APP_SETTINGS_COLUMNS \
+        "SELECT unique_id,display_name,trigger_id_type,trigger_id_data," \
+        "always_blocked,always_discouraged,sensitivity,starting_temperature,heat_rate,cool_rate," \
+        "seconds_of_usage_before_new_task,temperature_refresh_interval_in_seconds,heat," \
+        "task_maths_available,task_lines_available,task_clicks_available,task_count_available," \
         "conbustion_possible,can_recover_from_conbustion_possible,conbustion_temp,recovery_length_in_hours_from_conbustion"
-        " FROM app_settings";
+
+static int load_app_rows(sqlite3 *db, const char *group_key, C4aContext *ctx) {
+    // trigger_timeout_in_seconds is optional: older settings files lack it.
     sqlite3_stmt *st = NULL;
-    int rc = sqlite3_prepare_v2(db, sel, -1, &st, NULL);
+    int rc = sqlite3_prepare_v2(db, APP_SETTINGS_COLUMNS ",trigger_timeout_in_seconds FROM app_settings", -1, &st, NULL);
+    if (rc != SQLITE_OK) rc = sqlite3_prepare_v2(db, APP_SETTINGS_COLUMNS " FROM app_settings", -1, &st, NULL);
     if (rc != SQLITE_OK) return -1;
+    int has_timeout = sqlite3_column_count(st) > 21;
     while ((rc = sqlite3_step(st)) == SQLITE_ROW) {
         C4aApp *app = calloc(1, sizeof(C4aApp));
         if (!app) break;
@@ -153,6 +161,7 @@ static int load_app_rows(sqlite3 *db, const char *group_key, C4aContext *ctx) {
         app->settings.can_recover_from_conbustion_possible = sqlite3_column_int(st, 18);
         app->settings.conbustion_temp = sqlite3_column_double(st, 19);
         app->settings.recovery_length_in_hours_from_conbustion = sqlite3_column_int(st, 20);
+        if (has_timeout) app->settings.trigger_timeout_in_seconds = sqlite3_column_double(st, 21);
         app->settings.group_key = strdup(group_key);
         // Duplicate unique_id handling: first wins; others ignored or fatal per _FAIL_ON_WARNINGS_
         if (app->settings.unique_id) {
@@ -183,36 +192,128 @@ static int load_app_rows(sqlite3 *db, const char *group_key, C4aContext *ctx) {
     return 0;
 }
 
-static int ensure_app_memory(const char *mem_db_path, const char *unique_id, C4aAppMemory *mem) {
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(mem_db_path, &db);
-    if (rc != SQLITE_OK) { if (db) sqlite3_close(db); return -1; }
-    const char *create_sql =
-        "CREATE TABLE IF NOT EXISTS app_memories ("
-        "mID INTEGER PRIMARY KEY AUTOINCREMENT UNIQUE NOT NULL DEFAULT 1,"
-        "app_unique_id STRING UNIQUE NOT NULL,"
-        "cooled BOOLEAN NOT NULL DEFAULT 1,"
-        "last_seen_running_timestamp STRING,"
-        "lifetime_opens INTEGER,"
-        "opens_since_last_cooled INTEGER DEFAULT 0,"
-        "date_time_of_last_free_open STRING,"
-        "current_heat FLOAT NOT NULL DEFAULT 0.0,"
-        "last_heat FLOAT NOT NULL DEFAULT 0.0,"
-        "current_temperature FLOAT NOT NULL DEFAULT 1.0,"
-        "last_open_time STRING,"
-        "burned BOOLEAN NOT NULL DEFAULT 0,"
-        "burned_forever BOOLEAN NOT NULL DEFAULT 0,"
-        "lifetime_numbr_of_times_burned INTEGER NOT NULL DEFAULT 0,"
-        "hours_remaining_until_not_burned FLOAT DEFAULT 0,"
-        "last_burned_date_time STRING)";
-    rc = sqlite3_exec(db, create_sql, NULL, NULL, NULL);
-    if (rc != SQLITE_OK) { sqlite3_close(db); return -1; }
-    sqlite3_stmt *st = NULL;
-    const char *sel = "SELECT cooled,last_seen_running_timestamp,lifetime_opens,opens_since_last_cooled,date_time_of_last_free_open,current_heat,last_heat,current_temperature,last_open_time,burned,burned_forever,lifetime_numbr_of_times_burned,hours_remaining_until_not_burned,last_burned_date_time FROM app_memories WHERE app_unique_id=?";
-    rc = sqlite3_prepare_v2(db, sel, -1, &st, NULL);
-    if (rc != SQLITE_OK) { sqlite3_close(db); return -1; }
+// Memory databases stay open for the daemon's lifetime, with their SELECT
+// and UPDATE statements prepared once and reset/rebound on every use. The
+// per-app backend has one database per app under APP_MEMORIES_DIR; the
+// consolidated backend keeps every row in C4A_MEMORY_DB_FILE, in WAL mode,
+// and writes a whole pass in one transaction. The journal backend
+// (c4a_journal.h) does without SQLite and syncs once per pass.
+struct C4aStoreDb {
+    char *path;
+    sqlite3 *db;
+    sqlite3_stmt *sel;
+    sqlite3_stmt *up;
+};
+
+static C4aStoreDb **g_dbs;
+static size_t g_db_count, g_db_cap;
+static C4aStoreStats g_stats;
+static int g_backend = C4A_STORE_BACKEND;
+static C4aStoreDb *g_tx;   // consolidated database with an open transaction
+static int g_journal_open;
+static int g_journal_batch; // journal saves wait for the pass's commit
+static unsigned g_image_gen = 1;  // bumped when a rollback loses saved images
+
+// Counters are bumped by the writer thread and read by the tick.
+#define STAT_INC(field) __atomic_fetch_add(&g_stats.field, 1, __ATOMIC_RELAXED)
+
+static const char *MEMORY_CREATE_SQL =
+    "CREATE TABLE IF NOT EXISTS app_memories ("
+    "mID INTEGER PRIMARY KEY AUTOINCREMENT UNIQUE NOT NULL DEFAULT 1,"
+    "app_unique_id STRING UNIQUE NOT NULL,"
+    "cooled BOOLEAN NOT NULL DEFAULT 1,"
+    "last_seen_running_timestamp STRING,"
+    "lifetime_opens INTEGER,"
+    "opens_since_last_cooled INTEGER DEFAULT 0,"
+    "date_time_of_last_free_open STRING,"
+    "current_heat FLOAT NOT NULL DEFAULT 0.0,"
+    "last_heat FLOAT NOT NULL DEFAULT 0.0,"
+    "current_temperature FLOAT NOT NULL DEFAULT 1.0,"
+    "last_open_time STRING,"
+    "burned BOOLEAN NOT NULL DEFAULT 0,"
+    "burned_forever BOOLEAN NOT NULL DEFAULT 0,"
+    "lifetime_numbr_of_times_burned INTEGER NOT NULL DEFAULT 0,"
+    "hours_remaining_until_not_burned FLOAT DEFAULT 0,"
+    "last_burned_date_time STRING)";
+static const char *MEMORY_SELECT_SQL =
+    "SELECT cooled,last_seen_running_timestamp,lifetime_opens,opens_since_last_cooled,date_time_of_last_free_open,current_heat,last_heat,current_temperature,last_open_time,burned,burned_forever,lifetime_numbr_of_times_burned,hours_remaining_until_not_burned,last_burned_date_time FROM app_memories WHERE app_unique_id=?";
+static const char *MEMORY_UPDATE_SQL =
+    "UPDATE app_memories SET "
+    "cooled=?,last_seen_running_timestamp=?,lifetime_opens=?,opens_since_last_cooled=?,date_time_of_last_free_open=?,"
+    "current_heat=?,last_heat=?,current_temperature=?,last_open_time=?,"
+    "burned=?,burned_forever=?,lifetime_numbr_of_times_burned=?,hours_remaining_until_not_burned=?,last_burned_date_time=?"
+    " WHERE app_unique_id=?";
+
+static void store_db_close(C4aStoreDb *sd) {
+    if (sd == g_tx) {
+        // Closing rolls the transaction back
+        g_tx = NULL;
+        __atomic_fetch_add(&g_image_gen, 1, __ATOMIC_RELAXED);
+    }
+    sqlite3_finalize(sd->sel); sd->sel = NULL;
+    sqlite3_finalize(sd->up); sd->up = NULL;
+    if (sd->db) sqlite3_close(sd->db);
+    sd->db = NULL;
+}
+
+// The open handle for path, opening it (and creating the table) on first
+// use or after an error closed it. NULL if the database cannot be opened.
+static C4aStoreDb *store_db(const char *path) {
+    C4aStoreDb *sd = NULL;
+    for (size_t i = 0; i < g_db_count; ++i) {
+        if (strcmp(g_dbs[i]->path, path) == 0) { sd = g_dbs[i]; break; }
+    }
+    if (!sd) {
+        if (g_db_count == g_db_cap) {
+            size_t ncap = g_db_cap ? g_db_cap * 2 : 64;
+            C4aStoreDb **nd = realloc(g_dbs, ncap * sizeof(C4aStoreDb*));
+            if (!nd) return NULL;
+            g_dbs = nd; g_db_cap = ncap;
+        }
+        sd = calloc(1, sizeof(C4aStoreDb));
+        if (!sd) return NULL;
+        sd->path = strdup(path);
+        if (!sd->path) { free(sd); return NULL; }
+        g_dbs[g_db_count++] = sd;
+    }
+    if (sd->db) return sd;
+    STAT_INC(opens);
+    if (sqlite3_open(path, &sd->db) != SQLITE_OK) {
+        syslog(LOG_WARNING, "open app memory failed: %s", path);
+        store_db_close(sd);
+        return NULL;
+    }
+    if (g_backend == C4A_STORE_CONSOLIDATED && strcmp(path, C4A_MEMORY_DB_FILE) == 0) {
+        // With synchronous=FULL each commit is one WAL append and one fsync.
+        sqlite3_exec(sd->db, "PRAGMA journal_mode=WAL", NULL, NULL, NULL);
+        sqlite3_exec(sd->db, "PRAGMA synchronous=FULL", NULL, NULL, NULL);
+    }
+    if (sqlite3_exec(sd->db, MEMORY_CREATE_SQL, NULL, NULL, NULL) != SQLITE_OK) { store_db_close(sd); return NULL; }
+    return sd;
+}
+
+static sqlite3_stmt *store_stmt(C4aStoreDb *sd, sqlite3_stmt **slot, const char *sql) {
+    if (*slot) {
+        sqlite3_reset(*slot);
+        sqlite3_clear_bindings(*slot);
+        return *slot;
+    }
+    STAT_INC(prepares);
+    if (sqlite3_prepare_v2(sd->db, sql, -1, slot, NULL) != SQLITE_OK) { *slot = NULL; return NULL; }
+    return *slot;
+}
+
+static int store_step(sqlite3_stmt *st) {
+    STAT_INC(steps);
+    return sqlite3_step(st);
+}
+
+// Reads unique_id's row into mem. Returns 1 if found, 0 if not, -1 on error.
+static int read_app_memory(C4aStoreDb *sd, const char *unique_id, C4aAppMemory *mem) {
+    sqlite3_stmt *st = store_stmt(sd, &sd->sel, MEMORY_SELECT_SQL);
+    if (!st) return -1;
     sqlite3_bind_text(st, 1, unique_id, -1, SQLITE_STATIC);
-    int step = sqlite3_step(st);
+    int step = store_step(st);
     if (step == SQLITE_ROW) {
         mem->cooled = sqlite3_column_int(st, 0);
         free(mem->last_seen_running_timestamp); mem->last_seen_running_timestamp = strdup((const char*)sqlite3_column_text(st, 1));
@@ -228,35 +329,87 @@ static int ensure_app_memory(const char *mem_db_path, const char *unique_id, C4a
         mem->lifetime_numbr_of_times_burned = sqlite3_column_int64(st, 11);
         mem->hours_remaining_until_not_burned = sqlite3_column_double(st, 12);
         free(mem->last_burned_date_time); mem->last_burned_date_time = strdup((const char*)sqlite3_column_text(st, 13));
-        sqlite3_finalize(st);
-        sqlite3_close(db);
-        return 0;
+        sqlite3_reset(st);
+        return 1;
     }
-    sqlite3_finalize(st);
+    sqlite3_reset(st);
+    return 0;
+}
+
+// read_app_memory on a database opened read-only for this one call. A
+// read-only reader of a WAL database still creates its -wal and -shm files;
+// when there is no -wal (the last writer checkpointed and closed) the file is
+// opened immutable instead, so nothing at all is written.
+static int read_app_memory_file(const char *path, const char *unique_id, C4aAppMemory *mem, int wal) {
+    if (!file_exists(path)) return 0;
+    C4aStoreDb ro = { (char*)path, NULL, NULL, NULL };
+    char name[PATH_MAX + 32];
+    int flags = SQLITE_OPEN_READONLY;
+    snprintf(name, sizeof(name), "%s-wal", path);
+    if (wal && !file_exists(name)) {
+        snprintf(name, sizeof(name), "file:%s?immutable=1", path);
+        flags |= SQLITE_OPEN_URI;
+    } else {
+        snprintf(name, sizeof(name), "%s", path);
+    }
+    STAT_INC(opens);
+    if (sqlite3_open_v2(name, &ro.db, flags, NULL) != SQLITE_OK) { store_db_close(&ro); return -1; }
+    int found = read_app_memory(&ro, unique_id, mem);
+    store_db_close(&ro);
+    return found;
+}
+
+static int save_app_memory_impl(C4aStoreDb *sd, const char *unique_id, const C4aAppMemory *m);
+
+// Copies the row from a per-app database the consolidated store has not
+// imported yet. The old file is left alone. Returns 1 if a row was copied.
+static int migrate_app_memory(C4aStoreDb *sd, const char *per_app_path, const char *unique_id, C4aAppMemory *mem) {
+    int found = read_app_memory_file(per_app_path, unique_id, mem, 0);
+    if (found != 1) return found;
+    syslog(LOG_NOTICE, "Migrating app memory of %s from %s", unique_id, per_app_path);
+    if (g_backend == C4A_STORE_JOURNAL) return c4a_journal_save(unique_id, mem, 0) == 0 ? 1 : -1;
+    return save_app_memory_impl(sd, unique_id, mem) == 0 ? 1 : -1;
+}
+
+// Returns 1 when mem now matches the stored row, 0 when a default row was
+// inserted (mem is left as it was), -1 on error.
+static int ensure_app_memory(C4aStoreDb *sd, const char *per_app_path, const char *unique_id, C4aAppMemory *mem) {
+    if (g_backend == C4A_STORE_JOURNAL) {
+        if (c4a_journal_load(unique_id, mem)) return 1;
+        return migrate_app_memory(NULL, per_app_path, unique_id, mem) == 1;
+    }
+    int found = read_app_memory(sd, unique_id, mem);
+    if (found != 0) return found;
+    // Runs once per app, at load: not worth caching.
+    sqlite3_stmt *st = NULL;
     const char *ins = "INSERT OR IGNORE INTO app_memories (app_unique_id) VALUES (?)";
-    rc = sqlite3_prepare_v2(db, ins, -1, &st, NULL);
-    if (rc == SQLITE_OK) {
+    STAT_INC(prepares);
+    if (sqlite3_prepare_v2(sd->db, ins, -1, &st, NULL) == SQLITE_OK) {
         sqlite3_bind_text(st, 1, unique_id, -1, SQLITE_STATIC);
-        sqlite3_step(st);
+        store_step(st);
     }
     sqlite3_finalize(st);
-    sqlite3_close(db);
+    if (g_backend == C4A_STORE_CONSOLIDATED && migrate_app_memory(sd, per_app_path, unique_id, mem) == 1) return 1;
     return 0;
 }
 
-static int save_app_memory_impl(const char *mem_db_path, const char *unique_id, const C4aAppMemory *m) {
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(mem_db_path, &db);
-    if (rc != SQLITE_OK) { if (db) sqlite3_close(db); return -1; }
-    const char *up =
-        "UPDATE app_memories SET "
-        "cooled=?,last_seen_running_timestamp=?,lifetime_opens=?,opens_since_last_cooled=?,date_time_of_last_free_open=?,"
-        "current_heat=?,last_heat=?,current_temperature=?,last_open_time=?,"
-        "burned=?,burned_forever=?,lifetime_numbr_of_times_burned=?,hours_remaining_until_not_burned=?,last_burned_date_time=?"
-        " WHERE app_unique_id=?";
-    sqlite3_stmt *st = NULL;
-    rc = sqlite3_prepare_v2(db, up, -1, &st, NULL);
-    if (rc != SQLITE_OK) { sqlite3_close(db); return -1; }
+// What ensure_app_memory would load, for a simulated context (replay): files
+// are only read, so no database, row or journal is created or migrated.
+static int peek_app_memory(const char *per_app_path, const char *unique_id, C4aAppMemory *mem) {
+    static int journal_read;
+    if (g_backend == C4A_STORE_JOURNAL) {
+        if (!journal_read && c4a_journal_read(C4A_JOURNAL_FILE, C4A_JOURNAL_SNAPSHOT_FILE) == 0) journal_read = 1;
+        if (c4a_journal_load(unique_id, mem)) return 1;
+    } else if (g_backend == C4A_STORE_CONSOLIDATED) {
+        int found = read_app_memory_file(C4A_MEMORY_DB_FILE, unique_id, mem, 1);
+        if (found != 0) return found;
+    }
+    return read_app_memory_file(per_app_path, unique_id, mem, 0);
+}
+
+static int save_app_memory_impl(C4aStoreDb *sd, const char *unique_id, const C4aAppMemory *m) {
+    sqlite3_stmt *st = store_stmt(sd, &sd->up, MEMORY_UPDATE_SQL);
+    if (!st) { store_db_close(sd); return -1; }
     sqlite3_bind_int(st, 1, m->cooled);
     sqlite3_bind_text(st, 2, m->last_seen_running_timestamp ? m->last_seen_running_timestamp : "", -1, SQLITE_STATIC);
     sqlite3_bind_int64(st, 3, m->lifetime_opens);
@@ -272,17 +425,158 @@ static int save_app_memory_impl(const char *mem_db_path, const char *unique_id,
     sqlite3_bind_double(st, 13, m->hours_remaining_until_not_burned);
     sqlite3_bind_text(st, 14, m->last_burned_date_time ? m->last_burned_date_time : "", -1, SQLITE_STATIC);
     sqlite3_bind_text(st, 15, unique_id, -1, SQLITE_STATIC);
-    sqlite3_step(st);
-    sqlite3_finalize(st);
-    sqlite3_close(db);
+    int rc = store_step(st);
+    sqlite3_reset(st);
+    if (rc != SQLITE_DONE) {
+        // Reopen on the next save, in case the file was replaced underneath us.
+        syslog(LOG_WARNING, "app memory save failed (%d): %s", rc, sd->path);
+        store_db_close(sd);
+        return -1;
+    }
+    return 0;
+}
+
+void c4a_store_stats(C4aStoreStats *out) {
+    if (!out) return;
+    out->opens = __atomic_load_n(&g_stats.opens, __ATOMIC_RELAXED);
+    out->prepares = __atomic_load_n(&g_stats.prepares, __ATOMIC_RELAXED);
+    out->steps = __atomic_load_n(&g_stats.steps, __ATOMIC_RELAXED);
+    out->skipped = __atomic_load_n(&g_stats.skipped, __ATOMIC_RELAXED);
+    out->queued = __atomic_load_n(&g_stats.queued, __ATOMIC_RELAXED);
+    out->queue_full = __atomic_load_n(&g_stats.queue_full, __ATOMIC_RELAXED);
+    out->flushes = __atomic_load_n(&g_stats.flushes, __ATOMIC_RELAXED);
+    C4aJournalStats js;
+    c4a_journal_stats(&js);
+    out->appends = js.appends;
+    out->syncs = js.syncs;
+    out->compactions = js.compactions;
+}
+
+static void wb_stop(void);
+static int store_begin(void);
+static int store_commit(void);
+
+static int journal_ready(void) {
+    if (g_journal_open) return 0;
+    if (!file_exists(C4A_JOURNAL_FILE)) ensure_parent_dir(C4A_JOURNAL_FILE);
+    if (c4a_journal_open(C4A_JOURNAL_FILE, C4A_JOURNAL_SNAPSHOT_FILE) != 0) return -1;
+    g_journal_open = 1;
     return 0;
 }
 
+void c4a_store_close(C4aContext *ctx) {
+    wb_stop();
+    if (ctx && !ctx->simulated) {
+        // Images the writer never got (ring full, failed flush) are still
+        // unremembered; write them now, in one batch.
+        store_begin();
+        for (size_t i = 0; i < ctx->app_count; ++i) c4a_save_app_memory(ctx, ctx->apps[i]);
+        store_commit();
+    }
+    // Entries stay allocated: apps keep pointing at them.
+    for (size_t i = 0; i < g_db_count; ++i) store_db_close(g_dbs[i]);
+    if (g_journal_open) c4a_journal_close();
+    g_journal_open = 0;
+}
+
+int c4a_store_set_backend(int backend) {
+    if (backend != C4A_STORE_PER_APP && backend != C4A_STORE_CONSOLIDATED && backend != C4A_STORE_JOURNAL) return -1;
+    if (g_db_count > 0 || g_journal_open) return -1;
+    g_backend = backend;
+    return 0;
+}
+
+static int store_begin(void) {
+    if (g_backend == C4A_STORE_JOURNAL) {
+        g_journal_batch = 1;
+        return 0;
+    }
+    if (g_backend != C4A_STORE_CONSOLIDATED || g_tx) return 0;
+    C4aStoreDb *sd = store_db(C4A_MEMORY_DB_FILE);
+    if (!sd) return -1;
+    STAT_INC(steps);
+    if (sqlite3_exec(sd->db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK) return -1;
+    g_tx = sd;
+    return 0;
+}
+
+static int store_commit(void) {
+    if (g_journal_batch) {
+        g_journal_batch = 0;
+        if (!g_journal_open) return 0;
+        if (c4a_journal_sync() != 0) { __atomic_fetch_add(&g_image_gen, 1, __ATOMIC_RELAXED); return -1; }
+        return 1;
+    }
+    if (!g_tx) return 0;
+    C4aStoreDb *sd = g_tx;
+    g_tx = NULL;
+    STAT_INC(steps);
+    if (sqlite3_exec(sd->db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+        syslog(LOG_WARNING, "app memory commit failed: %s", sqlite3_errmsg(sd->db));
+        sqlite3_exec(sd->db, "ROLLBACK", NULL, NULL, NULL);
+        __atomic_fetch_add(&g_image_gen, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    return 1;
+}
+
+static uint64_t hash_bytes(uint64_t h, const void *p, size_t n) {
+    const unsigned char *b = p;
+    for (size_t i = 0; i < n; ++i) { h ^= b[i]; h *= 1099511628211ULL; }
+    return h;
+}
+
+static uint64_t hash_str(uint64_t h, const char *s) {
+    // NULL and "" are stored alike; the length keeps fields apart
+    size_t n = s ? strlen(s) : 0;
+    h = hash_bytes(h, &n, sizeof(n));
+    return s ? hash_bytes(h, s, n) : h;
+}
+
+// FNV-1a over every persisted column, as save_app_memory_impl writes them.
+static uint64_t memory_image_hash(const C4aAppMemory *m) {
+    uint64_t h = 14695981039346656037ULL;
+    h = hash_bytes(h, &m->cooled, sizeof(m->cooled));
+    h = hash_str(h, m->last_seen_running_timestamp);
+    h = hash_bytes(h, &m->lifetime_opens, sizeof(m->lifetime_opens));
+    h = hash_bytes(h, &m->opens_since_last_cooled, sizeof(m->opens_since_last_cooled));
+    h = hash_str(h, m->date_time_of_last_free_open);
+    h = hash_bytes(h, &m->current_heat, sizeof(m->current_heat));
+    h = hash_bytes(h, &m->last_heat, sizeof(m->last_heat));
+    h = hash_bytes(h, &m->current_temperature, sizeof(m->current_temperature));
+    h = hash_str(h, m->last_open_time);
+    h = hash_bytes(h, &m->burned, sizeof(m->burned));
+    h = hash_bytes(h, &m->burned_forever, sizeof(m->burned_forever));
+    h = hash_bytes(h, &m->lifetime_numbr_of_times_burned, sizeof(m->lifetime_numbr_of_times_burned));
+    h = hash_bytes(h, &m->hours_remaining_until_not_burned, sizeof(m->hours_remaining_until_not_burned));
+    h = hash_str(h, m->last_burned_date_time);
+    return h;
+}
+
+// gen is the generation read before the image was handed over: a failure
+// after that bumps past it, so the app is offered again.
+static void remember_image(C4aApp *app, uint64_t h, unsigned gen) {
+    app->stored_hash = h;
+    app->stored_gen = gen;
+}
+
+static char *memory_db_path(const char *uid) {
+    const char *base = APP_MEMORIES_DIR;
+    size_t len = strlen(base) + 1 + strlen(uid) + strlen(".sqlite") + 1;
+    char *fname = malloc(len);
+    if (fname) snprintf(fname, len, "%s/%s.sqlite", base, uid);
+    return fname;
+}
+
 int c4a_reload_globals(C4aContext *ctx) {
     if (!ctx) return -1;
     set_default_globals(&ctx->globals);
     char *gpath = path_join2(GLOBAL_SETTINGS_DIR, "global.sqlite");
     if (!gpath) return -1;
+    if (ctx->simulated && !file_exists(gpath)) {
+        free(gpath);
+        return 0;
+    }
     if (!file_exists(gpath)) {
         int pe = ensure_parent_dir(gpath);
         if (pe != 0) {
@@ -291,7 +585,7 @@ int c4a_reload_globals(C4aContext *ctx) {
             return 0;
         }
     }
-    if (load_globals_from_db(gpath, &ctx->globals) != 0) {
+    if (load_globals_from_db(gpath, &ctx->globals, ctx->simulated) != 0) {
         syslog(LOG_WARNING, "loading globals failed; using defaults");
     }
     free(gpath);
@@ -314,7 +608,8 @@ int c4a_load_apps(C4aContext *ctx) {
         char *path = path_join2(APP_SETTINGS_DIR, nm);
         if (!path) continue;
         sqlite3 *db = NULL;
-        if (sqlite3_open(path, &db) != SQLITE_OK) {
+        int rc = ctx->simulated ? sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, NULL) : sqlite3_open(path, &db);
+        if (rc != SQLITE_OK) {
             syslog(LOG_WARNING, "open app settings failed: %s", path);
             free(path);
             continue;
@@ -324,39 +619,287 @@ int c4a_load_apps(C4aContext *ctx) {
         free(path);
     }
     closedir(d);
+    c4a_detect_compile(ctx);
 
     for (size_t i = 0; i < ctx->app_count; ++i) {
         C4aApp *app = ctx->apps[i];
-        const char *base = APP_MEMORIES_DIR;
         const char *uid = app->settings.unique_id ? app->settings.unique_id : "unknown";
-        size_t len = strlen(base) + 1 + strlen(uid) + strlen(".sqlite") + 1;
-        char *fname = malloc(len);
-        if (fname) {
-            snprintf(fname, len, "%s/%s.sqlite", base, uid);
-            if (!file_exists(fname)) { ensure_parent_dir(fname); }
-            ensure_app_memory(fname, uid, &app->memory);
+        char *fname = memory_db_path(uid);
+        if (fname && ctx->simulated) {
+            if (peek_app_memory(fname, uid, &app->memory) == 1) remember_image(app, memory_image_hash(&app->memory), __atomic_load_n(&g_image_gen, __ATOMIC_RELAXED));
+            free(fname);
+        } else if (fname) {
+            C4aStoreDb *sd = NULL;
+            int ready;
+            if (g_backend == C4A_STORE_JOURNAL) {
+                ready = journal_ready() == 0;
+            } else {
+                const char *dbpath = g_backend == C4A_STORE_CONSOLIDATED ? C4A_MEMORY_DB_FILE : fname;
+                if (!file_exists(dbpath)) { ensure_parent_dir(dbpath); }
+                sd = store_db(dbpath);
+                ready = sd != NULL;
+            }
+            if (ready && ensure_app_memory(sd, fname, uid, &app->memory) == 1) remember_image(app, memory_image_hash(&app->memory), __atomic_load_n(&g_image_gen, __ATOMIC_RELAXED));
+            app->store = sd;
             free(fname);
         }
     }
+    // Imported rows
+    if (g_journal_open) c4a_journal_sync();
+    return 0;
+}
+
+// Writes one image with the selected backend. *sdp caches the database
+// handle between calls (NULL or closed: looked up again).
+static int store_write(C4aStoreDb **sdp, const char *uid, const C4aAppMemory *m) {
+    if (g_backend == C4A_STORE_JOURNAL) {
+        if (journal_ready() != 0) return -1;
+        return c4a_journal_save(uid, m, !g_journal_batch);
+    }
+    if (!*sdp || !(*sdp)->db) {
+        if (g_backend == C4A_STORE_CONSOLIDATED) {
+            *sdp = store_db(C4A_MEMORY_DB_FILE);
+        } else {
+            char *fname = memory_db_path(uid);
+            if (!fname) return -1;
+            *sdp = store_db(fname);
+            free(fname);
+        }
+        if (!*sdp) return -1;
+    }
+    return save_app_memory_impl(*sdp, uid, m);
+}
+
+// Write-behind: the tick queues private copies of changed images on a
+// single-producer/single-consumer ring, and the writer thread writes them
+// in batches with the selected backend, so the tick never waits for the
+// disk. Once the writer runs it owns the backend state above.
+typedef struct {
+    const void *key;        // the app; compared, never dereferenced
+    C4aStoreDb *sd;
+    char *uid;
+    C4aAppMemory mem;
+} WbRec;
+
+static WbRec *g_ring[C4A_WRITER_QUEUE];
+static size_t g_ring_head;  // next slot to consume, written by the writer
+static size_t g_ring_tail;  // next slot to fill, written by the tick
+static pthread_t g_writer;
+static int g_writer_running;
+static pthread_mutex_t g_writer_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_writer_cv;
+static int g_writer_kick, g_writer_stop;
+
+static void wb_free(WbRec *r) {
+    if (!r) return;
+    free(r->uid);
+    free(r->mem.last_seen_running_timestamp);
+    free(r->mem.date_time_of_last_free_open);
+    free(r->mem.last_open_time);
+    free(r->mem.last_burned_date_time);
+    free(r);
+}
+
+static char *dup_or_null(const char *s) {
+    return s ? strdup(s) : NULL;
+}
+
+static WbRec *wb_copy(const C4aApp *app, const char *uid) {
+    WbRec *r = calloc(1, sizeof(WbRec));
+    if (!r) return NULL;
+    r->key = app;
+    r->sd = app->store;
+    r->mem = app->memory;
+    r->mem.last_seen_running_timestamp = dup_or_null(app->memory.last_seen_running_timestamp);
+    r->mem.date_time_of_last_free_open = dup_or_null(app->memory.date_time_of_last_free_open);
+    r->mem.last_open_time = dup_or_null(app->memory.last_open_time);
+    r->mem.last_burned_date_time = dup_or_null(app->memory.last_burned_date_time);
+    r->uid = strdup(uid);
+    if (!r->uid || (app->memory.last_seen_running_timestamp && !r->mem.last_seen_running_timestamp) ||
+        (app->memory.date_time_of_last_free_open && !r->mem.date_time_of_last_free_open) ||
+        (app->memory.last_open_time && !r->mem.last_open_time) ||
+        (app->memory.last_burned_date_time && !r->mem.last_burned_date_time)) {
+        wb_free(r);
+        return NULL;
+    }
+    return r;
+}
+
+// Producer side. Fails when the ring is full; the app then stays unsaved and
+// is offered again by the next pass.
+static int wb_enqueue(const C4aApp *app, const char *uid) {
+    size_t tail = g_ring_tail;
+    size_t used = tail - __atomic_load_n(&g_ring_head, __ATOMIC_ACQUIRE);
+    if (used >= C4A_WRITER_QUEUE) { STAT_INC(queue_full); return -1; }
+    WbRec *r = wb_copy(app, uid);
+    if (!r) return -1;
+    g_ring[tail % C4A_WRITER_QUEUE] = r;
+    __atomic_store_n(&g_ring_tail, tail + 1, __ATOMIC_RELEASE);
+    STAT_INC(queued);
+    if (used + 1 >= C4A_WRITER_FLUSH_RECORDS) {
+        pthread_mutex_lock(&g_writer_mu);
+        g_writer_kick = 1;
+        pthread_cond_signal(&g_writer_cv);
+        pthread_mutex_unlock(&g_writer_mu);
+    }
+    return 0;
+}
+
+typedef struct {
+    WbRec **recs;
+    size_t n, cap;
+} WbBatch;
+
+// Consumer side: moves queued images into the batch, keeping only the
+// newest per app.
+static void wb_drain(WbBatch *b) {
+    size_t head = g_ring_head;
+    size_t tail = __atomic_load_n(&g_ring_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        WbRec *r = g_ring[head % C4A_WRITER_QUEUE];
+        g_ring[head % C4A_WRITER_QUEUE] = NULL;
+        size_t k = 0;
+        while (k < b->n && b->recs[k]->key != r->key) ++k;
+        if (k < b->n) {
+            if (!r->sd) r->sd = b->recs[k]->sd;
+            wb_free(b->recs[k]);
+            b->recs[k] = r;
+            continue;
+        }
+        if (b->n == b->cap) {
+            size_t ncap = b->cap ? b->cap * 2 : 64;
+            WbRec **nr = realloc(b->recs, ncap * sizeof(WbRec*));
+            if (!nr) {
+                // Lost: make the tick offer every app again
+                wb_free(r);
+                __atomic_fetch_add(&g_image_gen, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            b->recs = nr; b->cap = ncap;
+        }
+        b->recs[b->n++] = r;
+    }
+    __atomic_store_n(&g_ring_head, head, __ATOMIC_RELEASE);
+}
+
+static void wb_flush(WbBatch *b) {
+    if (b->n == 0) return;
+    int ok = store_begin() == 0;
+    for (size_t k = 0; k < b->n; ++k) {
+        if (store_write(&b->recs[k]->sd, b->recs[k]->uid, &b->recs[k]->mem) != 0) ok = 0;
+    }
+    if (store_commit() < 0) ok = 0;
+    if (!ok) __atomic_fetch_add(&g_image_gen, 1, __ATOMIC_RELAXED);
+    for (size_t k = 0; k < b->n; ++k) wb_free(b->recs[k]);
+    b->n = 0;
+    STAT_INC(flushes);
+}
+
+static void *wb_thread(void *arg) {
+    (void)arg;
+    WbBatch batch = { NULL, 0, 0 };
+    double first = 0.0;  // when the oldest unflushed image arrived
+    for (;;) {
+        pthread_mutex_lock(&g_writer_mu);
+        if (!g_writer_kick && !g_writer_stop) {
+            double wait = C4A_WRITER_FLUSH_SECONDS;
+            if (batch.n > 0) {
+                wait = first + C4A_WRITER_FLUSH_SECONDS - c4a_mono_now();
+                if (wait < 0) wait = 0;
+            }
+            struct timespec until;
+#ifdef __linux__
+            clock_gettime(CLOCK_MONOTONIC, &until);
+#else
+            clock_gettime(CLOCK_REALTIME, &until);
+#endif
+            time_t secs = (time_t)wait;
+            until.tv_sec += secs;
+            until.tv_nsec += (long)((wait - (double)secs) * 1e9);
+            if (until.tv_nsec >= 1000000000L) { until.tv_sec++; until.tv_nsec -= 1000000000L; }
+            pthread_cond_timedwait(&g_writer_cv, &g_writer_mu, &until);
+        }
+        int stop = g_writer_stop;
+        g_writer_kick = 0;
+        pthread_mutex_unlock(&g_writer_mu);
+
+        size_t before = batch.n;
+        wb_drain(&batch);
+        if (before == 0 && batch.n > 0) first = c4a_mono_now();
+        if (batch.n > 0 && (stop || batch.n >= C4A_WRITER_FLUSH_RECORDS || c4a_mono_now() - first >= C4A_WRITER_FLUSH_SECONDS)) {
+            wb_flush(&batch);
+        }
+        if (stop && batch.n == 0 && __atomic_load_n(&g_ring_tail, __ATOMIC_ACQUIRE) == g_ring_head) break;
+    }
+    free(batch.recs);
+    return NULL;
+}
+
+int c4a_store_start_writer(void) {
+    if (g_writer_running) return 0;
+    g_writer_stop = 0;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+#ifdef __linux__
+    // The time sync thread may step the wall clock; wait in monotonic time.
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+    pthread_cond_init(&g_writer_cv, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&g_writer, NULL, wb_thread, NULL) != 0) {
+        pthread_cond_destroy(&g_writer_cv);
+        syslog(LOG_ERR, "Could not start the app memory writer; saving in the tick");
+        return -1;
+    }
+    g_writer_running = 1;
     return 0;
 }
 
+// Writes everything queued and stops the writer.
+static void wb_stop(void) {
+    if (!g_writer_running) return;
+    pthread_mutex_lock(&g_writer_mu);
+    g_writer_stop = 1;
+    pthread_cond_signal(&g_writer_cv);
+    pthread_mutex_unlock(&g_writer_mu);
+    pthread_join(g_writer, NULL);
+    g_writer_running = 0;
+    pthread_cond_destroy(&g_writer_cv);
+}
+
+int c4a_store_begin(C4aContext *ctx) {
+    if ((ctx && ctx->simulated) || g_writer_running) return 0;
+    return store_begin();
+}
+
+int c4a_store_commit(C4aContext *ctx) {
+    if ((ctx && ctx->simulated) || g_writer_running) return 0;
+    return store_commit();
+}
+
 int c4a_save_app_memory(C4aContext *ctx, C4aApp *app) {
-    (void)ctx;
     if (!app) return -1;
-    const char *base = APP_MEMORIES_DIR;
+    if (ctx && ctx->simulated) return 0;
+    uint64_t h = memory_image_hash(&app->memory);
+    unsigned gen = __atomic_load_n(&g_image_gen, __ATOMIC_ACQUIRE);
+    if (app->stored_gen == gen && app->stored_hash == h) {
+        STAT_INC(skipped);
+        return 1;
+    }
     const char *uid = app->settings.unique_id ? app->settings.unique_id : "unknown";
-    size_t len = strlen(base) + 1 + strlen(uid) + strlen(".sqlite") + 1;
-    char *fname = malloc(len);
-    if (!fname) return -1;
-    snprintf(fname, len, "%s/%s.sqlite", base, uid);
-    int rc = save_app_memory_impl(fname, uid, &app->memory);
-    free(fname);
-    return rc;
+    if (g_writer_running) {
+        if (wb_enqueue(app, uid) != 0) return -1;
+    } else if (store_write(&app->store, uid, &app->memory) != 0) {
+        return -1;
+    }
+    remember_image(app, h, gen);
+    return 0;
 }
 
 int c4a_bootstrap(C4aContext *ctx) {
     if (!ctx) return -1;
+    // The first tick decides free opens; it must not see raw system time.
+    if (!ctx->simulated) c4a_time_restore();
     c4a_reload_globals(ctx);
     c4a_load_apps(ctx);
     return 0;
@@ -6,7 +6,53 @@
 int c4a_bootstrap(C4aContext *ctx);
 int c4a_reload_globals(C4aContext *ctx);
 int c4a_load_apps(C4aContext *ctx);
+// Writes app's memory unless it is unchanged since the last load or save.
+// With the writer running, "written" means queued for it. Returns 0 when
+// written, 1 when skipped, -1 on error (the app stays unsaved).
 int c4a_save_app_memory(C4aContext *ctx, C4aApp *app);
 
+// Memory databases are opened once and kept open; these count the SQLite
+// work behind loads and saves since start, and the saves skipped because
+// the memory matched what was last stored.
+typedef struct {
+    uint64_t opens;
+    uint64_t prepares;
+    uint64_t steps;
+    uint64_t skipped;
+    uint64_t queued;        // write-behind
+    uint64_t queue_full;
+    uint64_t flushes;
+    uint64_t appends;       // journal backend (c4a_journal.h)
+    uint64_t syncs;
+    uint64_t compactions;
+} C4aStoreStats;
+
+void c4a_store_stats(C4aStoreStats *out);
+// Stops the writer after it has written everything queued, writes every app
+// of ctx (may be NULL) whose latest image is not yet stored, then closes
+// every cached database handle. Apps reopen theirs on the next save.
+void c4a_store_close(C4aContext *ctx);
+
+// Starts the write-behind thread. From then on saves only queue a copy of
+// the memory (up to C4A_WRITER_QUEUE, newest per app wins) and the writer
+// flushes once C4A_WRITER_FLUSH_RECORDS are waiting or the oldest has
+// waited C4A_WRITER_FLUSH_SECONDS, as one backend transaction. Call after
+// c4a_load_apps, in the process that keeps running.
+int c4a_store_start_writer(void);
+
+// Picks C4A_STORE_PER_APP, C4A_STORE_CONSOLIDATED or C4A_STORE_JOURNAL
+// (default C4A_STORE_BACKEND). Only before the first load or save; -1
+// otherwise. The consolidated and journal stores import an app's per-app
+// file the first time they see the app.
+int c4a_store_set_backend(int backend);
+// Bracket a pass's saves: with the consolidated store they become one
+// transaction, and one fsync; the journal syncs once at the commit. No-ops
+// for the per-app store. A failed save
+// inside the bracket rolls back the saves before it; they are written again
+// by the next pass. c4a_store_commit returns 1 when it committed. Both do
+// nothing while the writer runs: it brackets its own batches.
+int c4a_store_begin(C4aContext *ctx);
+int c4a_store_commit(C4aContext *ctx);
+
 #endif
 
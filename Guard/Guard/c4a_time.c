@@ -1,9 +1,23 @@
+#ifdef __linux__
+#define _GNU_SOURCE // timegm and strptime
+#elif defined(__APPLE__)
+#define _DARWIN_C_SOURCE // timegm
+#endif
 #include "include.h"
 #include "c4a_time.h"
 
-static double g_offset_seconds = 0.0; // network_epoch - system_epoch at sync time
+// network_epoch - system_epoch at sync time. Written by the sync thread,
+// read by anyone: the offset is stored before the flag is released.
+static double g_offset_seconds = 0.0;
 static int g_has_offset = 0;
 
+static pthread_mutex_t g_sync_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_sync_cv;
+static char g_sources[1024] = C4A_TIME_SYNC_URLS;
+static int g_sync_started = 0;
+static int g_sync_kick = 0;
+static double g_last_sync_seconds = -1.0;
+
 #if defined(CLOCK_MONOTONIC)
 #define HAVE_MONO 1
 #else
@@ -27,17 +41,9 @@ static int parse_http_date(const char *datestr, long *out_epoch) {
     struct tm tmv; memset(&tmv, 0, sizeof(tmv));
     char *res = strptime(datestr, "%a, %d %b %Y %H:%M:%S GMT", &tmv);
     if (!res) return -1;
-    // Use timegm if available; otherwise, convert as UTC via TZ workaround
-    time_t t;
-    #if defined(_BSD_SOURCE) || defined(__USE_BSD) || defined(__APPLE__)
-    extern time_t timegm(struct tm*);
-    t = timegm(&tmv);
-    #else
-    char *old = getenv("TZ");
-    setenv("TZ", "UTC", 1); tzset();
-    t = mktime(&tmv);
-    if (old) setenv("TZ", old, 1); else unsetenv("TZ"); tzset();
-    #endif
+    // timegm, not mktime under TZ=UTC: this runs on the sync thread while the
+    // tick uses the local time zone.
+    time_t t = timegm(&tmv);
     if (t <= 0) return -1;
     *out_epoch = (long)t;
     return 0;
@@ -60,29 +66,135 @@ static int fetch_http_date_from(const char *url, long *out_epoch) {
     return 0;
 }
 
+static void publish_offset(double offset) {
+    __atomic_store(&g_offset_seconds, &offset, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_has_offset, 1, __ATOMIC_RELEASE);
+}
+
+static void save_offset(double offset) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", C4A_TIME_OFFSET_FILE);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    int bad = fprintf(f, "%.3f %.0f\n", offset, (double)time(NULL)) < 0;
+    if (fclose(f) != 0) bad = 1;
+    if (bad || rename(tmp, C4A_TIME_OFFSET_FILE) != 0) {
+        syslog(LOG_WARNING, "Could not save time offset to %s", C4A_TIME_OFFSET_FILE);
+        unlink(tmp);
+    }
+}
+
+static void load_offset(void) {
+    FILE *f = fopen(C4A_TIME_OFFSET_FILE, "r");
+    if (!f) return;
+    double offset = 0.0, synced = 0.0;
+    if (fscanf(f, "%lf %lf", &offset, &synced) == 2 && isfinite(offset)) {
+        publish_offset(offset);
+        syslog(LOG_NOTICE, "Time offset %.0f sec restored (synced at %.0f)", offset, synced);
+    }
+    fclose(f);
+}
+
+void c4a_time_restore(void) {
+    if (!__atomic_load_n(&g_has_offset, __ATOMIC_ACQUIRE)) load_offset();
+}
+
 int c4a_time_sync(void) {
-    const char *urls[] = {
-        "https://www.google.com",
-        "https://www.apple.com",
-        "https://www.cloudflare.com",
-        NULL
-    };
-    for (int i = 0; urls[i]; ++i) {
+    char sources[sizeof(g_sources)];
+    pthread_mutex_lock(&g_sync_mu);
+    memcpy(sources, g_sources, sizeof(sources));
+    pthread_mutex_unlock(&g_sync_mu);
+    double t0 = c4a_mono_now();
+    int rc = -1;
+    char *save = NULL;
+    for (char *url = strtok_r(sources, " ,", &save); url; url = strtok_r(NULL, " ,", &save)) {
         long net_epoch = 0;
-        if (fetch_http_date_from(urls[i], &net_epoch) == 0) {
+        if (fetch_http_date_from(url, &net_epoch) == 0) {
             time_t sys_epoch = time(NULL);
-            g_offset_seconds = (double)net_epoch - (double)sys_epoch;
-            g_has_offset = 1;
-            syslog(LOG_NOTICE, "Time sync success: offset=%.0f sec from %s", g_offset_seconds, urls[i]);
-            return 0;
+            double offset = (double)net_epoch - (double)sys_epoch;
+            publish_offset(offset);
+            save_offset(offset);
+            syslog(LOG_NOTICE, "Time sync success: offset=%.0f sec from %s", offset, url);
+            rc = 0;
+            break;
+        }
+    }
+    if (rc != 0) syslog(LOG_WARNING, "Time sync failed (no sources)");
+    double took = c4a_mono_now() - t0;
+    __atomic_store(&g_last_sync_seconds, &took, __ATOMIC_RELAXED);
+    return rc;
+}
+
+static void *sync_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        double wait = c4a_time_sync() == 0 ? C4A_TIME_SYNC_INTERVAL_SECONDS : C4A_TIME_SYNC_RETRY_SECONDS;
+        struct timespec until;
+#ifdef __linux__
+        clock_gettime(CLOCK_MONOTONIC, &until);
+#else
+        clock_gettime(CLOCK_REALTIME, &until);
+#endif
+        until.tv_sec += (time_t)wait;
+        pthread_mutex_lock(&g_sync_mu);
+        while (!g_sync_kick) {
+            if (pthread_cond_timedwait(&g_sync_cv, &g_sync_mu, &until) == ETIMEDOUT) break;
         }
+        g_sync_kick = 0;
+        pthread_mutex_unlock(&g_sync_mu);
+    }
+    return NULL;
+}
+
+int c4a_time_sync_start(void) {
+    pthread_mutex_lock(&g_sync_mu);
+    if (g_sync_started) { pthread_mutex_unlock(&g_sync_mu); return 0; }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+#ifdef __linux__
+    // Wait in monotonic time so a system clock change cannot delay the sync.
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+    pthread_cond_init(&g_sync_cv, &attr);
+    pthread_condattr_destroy(&attr);
+    c4a_time_restore();
+    pthread_t th;
+    if (pthread_create(&th, NULL, sync_thread, NULL) != 0) {
+        pthread_cond_destroy(&g_sync_cv);
+        pthread_mutex_unlock(&g_sync_mu);
+        syslog(LOG_ERR, "Could not start time sync thread");
+        return -1;
     }
-    syslog(LOG_WARNING, "Time sync failed (no sources)");
-    return -1;
+    pthread_detach(th);
+    g_sync_started = 1;
+    pthread_mutex_unlock(&g_sync_mu);
+    return 0;
+}
+
+int c4a_time_set_sources(const char *urls) {
+    if (!urls || strchr(urls, '\'') || strlen(urls) >= sizeof(g_sources)) return -1;
+    pthread_mutex_lock(&g_sync_mu);
+    snprintf(g_sources, sizeof(g_sources), "%s", urls);
+    if (g_sync_started) {
+        g_sync_kick = 1;
+        pthread_cond_signal(&g_sync_cv);
+    }
+    pthread_mutex_unlock(&g_sync_mu);
+    return 0;
+}
+
+double c4a_time_sync_take_duration(void) {
+    double none = -1.0, v;
+    __atomic_exchange(&g_last_sync_seconds, &none, &v, __ATOMIC_RELAXED);
+    return v;
 }
 
 double c4a_trusted_epoch_now(void) {
     time_t sys_epoch = time(NULL);
-    if (g_has_offset) return (double)sys_epoch + g_offset_seconds;
+    if (__atomic_load_n(&g_has_offset, __ATOMIC_ACQUIRE)) {
+        double offset;
+        __atomic_load(&g_offset_seconds, &offset, __ATOMIC_RELAXED);
+        return (double)sys_epoch + offset;
+    }
     return (double)sys_epoch;
 }
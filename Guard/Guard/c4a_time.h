@@ -6,10 +6,33 @@
 // Returns a monotonic timestamp in seconds (not affected by system time changes)
 double c4a_mono_now(void);
 
-// Attempts to sync with network time sources and caches an offset.
-// Returns 0 on success, non-zero otherwise.
+// Attempts to sync with network time sources and caches an offset, which is
+// also saved to C4A_TIME_OFFSET_FILE. Blocks for up to a few seconds per
+// source. Returns 0 on success, non-zero otherwise.
 int c4a_time_sync(void);
 
+// Restores the offset saved by an earlier run unless one is cached already,
+// so trusted time is available before the first network round trip. Called
+// by c4a_bootstrap, ahead of the first tick.
+void c4a_time_restore(void);
+
+// Starts the background sync thread (once; later calls do nothing),
+// restoring the saved offset first if needed. The thread syncs every
+// C4A_TIME_SYNC_INTERVAL_SECONDS, or C4A_TIME_SYNC_RETRY_SECONDS after a
+// failure. Call it in the process that keeps running: threads do not
+// survive fork.
+int c4a_time_sync_start(void);
+
+// Replaces the space- or comma-separated source URLs (default
+// C4A_TIME_SYNC_URLS), e.g. to point at a local HTTP server, and wakes the
+// sync thread to try them. Returns -1 if the list is too long or contains a
+// quote.
+int c4a_time_set_sources(const char *urls);
+
+// Duration of the last sync attempt in seconds, once; -1 if there was none
+// since the previous call.
+double c4a_time_sync_take_duration(void);
+
 // Returns a best-effort trusted epoch time in seconds, using network time if
 // available (system time + cached offset), else falls back to system time.
 double c4a_trusted_epoch_now(void);
@@ -0,0 +1,216 @@
+#include "include.h"
+#include "c4a_trace.h"
+#include "c4a_time.h"
+
+static C4aTraceRec g_ring[C4A_TRACE_RECORDS];
+static uint64_t g_head;
+static C4aTraceState g_cp[C4A_TRACE_CHECKPOINTS];
+static unsigned g_cp_next;
+static uint64_t g_cp_head;      // g_head at the last checkpoint
+static int g_cp_any;
+
+// After records, a dump holds this, then each checkpoint followed by its seq
+// as read around the copy (0 when it was being rewritten).
+typedef struct {
+    uint32_t count;
+    uint32_t state_size;
+} CheckpointsHead;
+
+void c4a_trace(C4aTraceType type, int32_t app, int64_t a, int64_t b) {
+    uint64_t seq = __atomic_fetch_add(&g_head, 1, __ATOMIC_RELAXED);
+    C4aTraceRec *r = &g_ring[seq % C4A_TRACE_RECORDS];
+    // A reader that sees seq unchanged around its copy has a whole record.
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    r->mono = c4a_mono_now();
+    r->type = (uint32_t)type;
+    r->app = app;
+    r->a = a;
+    r->b = b;
+    __atomic_store_n(&r->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+C4aTraceState *c4a_trace_checkpoint_begin(void) {
+    uint64_t head = __atomic_load_n(&g_head, __ATOMIC_RELAXED);
+    if (g_cp_any && head - g_cp_head < C4A_TRACE_RECORDS / C4A_TRACE_CHECKPOINTS) return NULL;
+    C4aTraceState *st = &g_cp[g_cp_next];
+    __atomic_store_n(&st->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return st;
+}
+
+void c4a_trace_checkpoint_done(C4aTraceState *st, double mono) {
+    uint64_t head = __atomic_load_n(&g_head, __ATOMIC_RELAXED);
+    st->mono = mono;
+    __atomic_store_n(&st->seq, head + 1, __ATOMIC_RELEASE);
+    g_cp_next = (g_cp_next + 1) % C4A_TRACE_CHECKPOINTS;
+    g_cp_head = head;
+    g_cp_any = 1;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n; len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Only open/write/rename and atomics: this runs inside signal handlers.
+int c4a_trace_dump(void) {
+    int saved = errno;
+    int fd = open(C4A_TRACE_FILE ".tmp", O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) { errno = saved; return -1; }
+    C4aTraceHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, C4A_TRACE_MAGIC, sizeof(h.magic));
+    h.version = 2;
+    h.rec_size = sizeof(C4aTraceRec);
+    h.records = C4A_TRACE_RECORDS;
+    h.head = __atomic_load_n(&g_head, __ATOMIC_ACQUIRE);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    h.mono = (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    h.epoch = (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+    int rc = write_all(fd, &h, sizeof(h));
+    C4aTraceRec chunk[64];
+    for (size_t i = 0; rc == 0 && i < C4A_TRACE_RECORDS; i += 64) {
+        size_t n = C4A_TRACE_RECORDS - i < 64 ? C4A_TRACE_RECORDS - i : 64;
+        for (size_t k = 0; k < n; ++k) {
+            const C4aTraceRec *r = &g_ring[i + k];
+            uint64_t s1 = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+            chunk[k] = *r;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) != s1) s1 = 0;
+            chunk[k].seq = s1; // torn records are dropped by the decoder
+        }
+        rc = write_all(fd, chunk, n * sizeof(C4aTraceRec));
+    }
+    CheckpointsHead ch = { C4A_TRACE_CHECKPOINTS, sizeof(C4aTraceState) };
+    if (rc == 0) rc = write_all(fd, &ch, sizeof(ch));
+    for (size_t i = 0; rc == 0 && i < C4A_TRACE_CHECKPOINTS; ++i) {
+        const C4aTraceState *st = &g_cp[i];
+        uint64_t s1 = __atomic_load_n(&st->seq, __ATOMIC_ACQUIRE);
+        rc = write_all(fd, st, sizeof(*st));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&st->seq, __ATOMIC_RELAXED) != s1) s1 = 0;
+        if (rc == 0) rc = write_all(fd, &s1, sizeof(s1));
+    }
+    if (close(fd) != 0) rc = -1;
+    if (rc == 0) rc = rename(C4A_TRACE_FILE ".tmp", C4A_TRACE_FILE);
+    else unlink(C4A_TRACE_FILE ".tmp");
+    errno = saved;
+    return rc;
+}
+
+static void (*volatile g_fatal_hook)(void);
+
+void c4a_trace_on_fatal(void (*fn)(void)) {
+    g_fatal_hook = fn;
+}
+
+void c4a_trace_fatal(void) {
+    void (*fn)(void) = g_fatal_hook;
+    if (fn) fn();
+    c4a_trace_dump();
+}
+
+static void trace_usr1(int sig) {
+    (void)sig;
+    c4a_trace_dump();
+}
+
+static void trace_fatal(int sig) {
+    c4a_trace_fatal();
+    // SA_RESETHAND restored the default action; let it take the process down.
+    raise(sig);
+}
+
+void c4a_trace_init(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_handler = trace_usr1;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, NULL);
+    sa.sa_handler = trace_fatal;
+    sa.sa_flags = SA_RESETHAND;
+    static const int fatal[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, SIGTERM, SIGINT };
+    for (size_t i = 0; i < sizeof(fatal) / sizeof(fatal[0]); ++i) sigaction(fatal[i], &sa, NULL);
+}
+
+const char *c4a_trace_type_name(uint32_t type) {
+    static const char *const names[C4A_TR_TYPE_COUNT] = {
+        "none", "tick", "detect", "running", "allowed", "burned", "kill",
+        "freeze", "thaw", "task_start", "task_exit", "persist", "proc_event", "request"
+    };
+    return type < C4A_TR_TYPE_COUNT ? names[type] : "unknown";
+}
+
+static int by_seq(const void *x, const void *y) {
+    const C4aTraceRec *a = x, *b = y;
+    return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+C4aTraceRec *c4a_trace_load(const char *path, C4aTraceHeader *h, size_t *n) {
+    FILE *f = fopen(path, "rb");
+    if (!f) { fprintf(stderr, "%s: %s\n", path, strerror(errno)); return NULL; }
+    if (fread(h, sizeof(*h), 1, f) != 1 || memcmp(h->magic, C4A_TRACE_MAGIC, sizeof(h->magic)) != 0) {
+        fprintf(stderr, "%s: not a trace dump\n", path);
+        fclose(f);
+        return NULL;
+    }
+    if ((h->version != 1 && h->version != 2) || h->rec_size != sizeof(C4aTraceRec) || h->records == 0 || h->records > (1u << 24)) {
+        fprintf(stderr, "%s: unsupported dump (version %u, record size %u)\n", path, h->version, h->rec_size);
+        fclose(f);
+        return NULL;
+    }
+    C4aTraceRec *recs = calloc((size_t)h->records, sizeof(C4aTraceRec));
+    if (!recs) { fclose(f); return NULL; }
+    size_t got = fread(recs, sizeof(C4aTraceRec), (size_t)h->records, f);
+    fclose(f);
+    // Drop empty and torn slots, and late writes from a writer that was
+    // preempted while the ring wrapped, then restore event order.
+    uint64_t first = h->head > h->records ? h->head - h->records + 1 : 1;
+    size_t kept = 0;
+    for (size_t i = 0; i < got; ++i) if (recs[i].seq >= first) recs[kept++] = recs[i];
+    qsort(recs, kept, sizeof(C4aTraceRec), by_seq);
+    *n = kept;
+    return recs;
+}
+
+int c4a_trace_load_state(const char *path, uint64_t first_seq, C4aTraceState *out) {
+    C4aTraceHeader h;
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    CheckpointsHead ch;
+    int found = 0;
+    // Version 1 dumps have no checkpoints.
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, C4A_TRACE_MAGIC, sizeof(h.magic)) != 0 || h.version != 2 ||
+        fseek(f, (long)(h.records * h.rec_size), SEEK_CUR) != 0 || fread(&ch, sizeof(ch), 1, f) != 1) {
+        fclose(f);
+        return -1;
+    }
+    if (ch.state_size != sizeof(C4aTraceState)) {
+        fprintf(stderr, "%s: checkpoints of another build (%u bytes)\n", path, ch.state_size);
+        fclose(f);
+        return -1;
+    }
+    C4aTraceState *st = malloc(sizeof(*st));
+    for (uint32_t i = 0; st && i < ch.count; ++i) {
+        uint64_t seq;
+        if (fread(st, sizeof(*st), 1, f) != 1 || fread(&seq, sizeof(seq), 1, f) != 1) break;
+        if (seq == 0 || seq < first_seq || st->napps > C4A_TRACE_STATE_APPS) continue;
+        if (found && seq >= out->seq) continue;
+        *out = *st;
+        out->seq = seq;
+        found = 1;
+    }
+    free(st);
+    fclose(f);
+    return found ? 0 : -1;
+}
@@ -0,0 +1,98 @@
+#ifndef C4A_TRACE_H
+#define C4A_TRACE_H
+
+#include <stdint.h>
+
+// Flight recorder: a fixed ring of C4A_TRACE_RECORDS binary events. Recording
+// is one atomic increment and a few stores, from any thread, without locks.
+// Next to it the last C4A_TRACE_CHECKPOINTS checkpoints of every app's state
+// are kept, so a replay can start from the state the surviving events began
+// in. Both are written to C4A_TRACE_FILE on SIGUSR1, on a fatal signal and
+// before a critical-error exit; c4a_trace_decode prints a dump as text.
+
+typedef enum {
+    C4A_TR_NONE,
+    C4A_TR_TICK,        // a = 1 periodic tick / 0 enforcement pass, b = duration us
+    C4A_TR_DETECT,      // app, a = matched pids, b = is_running
+    C4A_TR_RUNNING,     // app, a = is_running now
+    C4A_TR_ALLOWED,     // app, a = allowed now
+    C4A_TR_BURNED,      // app, a = temperature in thousandths
+    C4A_TR_KILL,        // a = pid, b = signal
+    C4A_TR_FREEZE,      // app, a = processes held
+    C4A_TR_THAW,        // app, a = processes released or closed
+    C4A_TR_TASK_START,  // app, a = pid (0 when nothing could run), b = N in thousandths
+    C4A_TR_TASK_EXIT,   // app, a = pid, b = 1 passed / 0 failed / -1 early exit
+    C4A_TR_PERSIST,     // app, a = duration us
+    C4A_TR_PROC_EVENT,  // a = pid, b = 1 exec / 2 fork, of a process needing enforcement
+    C4A_TR_REQUEST,     // app (-1 unknown), a = value in thousandths, b = C4aRequestType
+    C4A_TR_TYPE_COUNT
+} C4aTraceType;
+
+typedef struct {
+    uint64_t seq;       // 1-based position in the event stream, 0 while being written
+    double mono;        // c4a_mono_now()
+    uint32_t type;
+    int32_t app;        // index into the context's apps, -1 when not app-specific
+    int64_t a;
+    int64_t b;
+} C4aTraceRec;
+
+#define C4A_TRACE_MAGIC "C4ATRACE"
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t rec_size;
+    uint64_t records;   // ring capacity
+    uint64_t head;      // events recorded so far
+    double mono;        // clocks at the time of the dump, to place records in wall time
+    double epoch;
+} C4aTraceHeader;
+
+// One app at a checkpoint: the memory fields the tick reads and the runtime
+// state around them. Times are c4a_mono_now() readings.
+typedef struct {
+    double temperature, heat, last_heat, hours_remaining;
+    double last_free_open;      // epoch of date_time_of_last_free_open, 0 = none
+    double allowed_since, last_burn_check, last_warn, next_step;
+    int64_t opens_since_last_cooled, lifetime_opens, times_burned;
+    int32_t cooled, burned, burned_forever, allowed;
+    int32_t running, last_running, opened;  // opened: last_open_time is set
+    uint32_t samples, samples_running;
+    int32_t pad;
+} C4aTraceImage;
+
+typedef struct {
+    uint64_t seq;       // first record after the checkpoint, 0 = none or being written
+    double mono;
+    uint32_t napps;     // apps recorded, at most C4A_TRACE_STATE_APPS
+    uint32_t total;     // apps the guard had
+    C4aTraceImage apps[C4A_TRACE_STATE_APPS];
+} C4aTraceState;
+
+void c4a_trace(C4aTraceType type, int32_t app, int64_t a, int64_t b);
+// Slot for a new checkpoint when one is due: on the first call, then once
+// C4A_TRACE_RECORDS / C4A_TRACE_CHECKPOINTS events were recorded since the
+// last. NULL otherwise. Fill apps, napps and total, then call
+// c4a_trace_checkpoint_done. One thread only (the tick).
+C4aTraceState *c4a_trace_checkpoint_begin(void);
+void c4a_trace_checkpoint_done(C4aTraceState *st, double mono);
+// Installs the SIGUSR1 and fatal signal handlers (crashes, SIGTERM, SIGINT).
+void c4a_trace_init(void);
+// fn runs first on a fatal signal or critical-error exit, e.g. to release
+// what the guard holds. It must be async-signal-safe.
+void c4a_trace_on_fatal(void (*fn)(void));
+// The fatal path without the signal: the hook, then c4a_trace_dump.
+void c4a_trace_fatal(void);
+// Writes the ring to C4A_TRACE_FILE. Async-signal-safe. Returns 0 on success.
+int c4a_trace_dump(void);
+const char *c4a_trace_type_name(uint32_t type);
+// Reads a dump written by c4a_trace_dump. Returns the surviving records in
+// event order (free() them), with *n set and *h filled, or NULL on error.
+C4aTraceRec *c4a_trace_load(const char *path, C4aTraceHeader *h, size_t *n);
+// Reads the oldest checkpoint of a dump that no surviving event predates:
+// every event from out->seq on is in the dump, first_seq being the oldest
+// one. Returns 0, or -1 when there is none.
+int c4a_trace_load_state(const char *path, uint64_t first_seq, C4aTraceState *out);
+
+#endif
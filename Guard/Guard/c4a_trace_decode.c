@@ -0,0 +1,57 @@
+//
+//  c4a_trace_decode.c
+//  Guard
+//
+//  Prints a trace dump (C4A_TRACE_FILE, written on SIGUSR1 or a fatal error)
+//  as text, oldest event first. Not installed; build with
+//  `make c4a_trace_decode` and run `./c4a_trace_decode [dump]`.
+//
+
+#include "include.h"
+#include "c4a_trace.h"
+
+static void print_rec(const C4aTraceHeader *h, const C4aTraceRec *r) {
+    double when = h->epoch - (h->mono - r->mono);
+    time_t secs = (time_t)when;
+    struct tm tm;
+    char stamp[32];
+    localtime_r(&secs, &tm);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("%s.%03d #%llu %-11s", stamp, (int)((when - (double)secs) * 1000.0), (unsigned long long)r->seq, c4a_trace_type_name(r->type));
+    if (r->app >= 0) printf(" app=%d", r->app);
+    long long a = (long long)r->a, b = (long long)r->b;
+    switch (r->type) {
+    case C4A_TR_TICK:       printf(" %s %lldus", a ? "tick" : "enforce", b); break;
+    case C4A_TR_DETECT:     printf(" pids=%lld running=%lld", a, b); break;
+    case C4A_TR_RUNNING:
+    case C4A_TR_ALLOWED:    printf(" -> %lld", a); break;
+    case C4A_TR_BURNED:     printf(" temperature=%.3f", (double)a / 1000.0); break;
+    case C4A_TR_KILL:       printf(" pid=%lld signal=%lld", a, b); break;
+    case C4A_TR_FREEZE:
+    case C4A_TR_THAW:       printf(" processes=%lld", a); break;
+    case C4A_TR_TASK_START: printf(" pid=%lld N=%.3f", a, (double)b / 1000.0); break;
+    case C4A_TR_TASK_EXIT:  printf(" pid=%lld %s", a, b < 0 ? "early-exit" : b ? "passed" : "failed"); break;
+    case C4A_TR_PERSIST:    printf(" %lldus", a); break;
+    case C4A_TR_PROC_EVENT: printf(" pid=%lld %s", a, b == 2 ? "fork" : "exec"); break;
+    case C4A_TR_REQUEST: {
+        static const char *const types[] = { "other", "upgrade_permanent", "extend_burn", "burn", "increase_temp" };
+        printf(" %s value=%.3f", b >= 0 && b <= 4 ? types[b] : "other", (double)a / 1000.0);
+        break;
+    }
+    default:                printf(" a=%lld b=%lld", a, b); break;
+    }
+    putchar('\n');
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : C4A_TRACE_FILE;
+    C4aTraceHeader h;
+    size_t kept = 0;
+    C4aTraceRec *recs = c4a_trace_load(path, &h, &kept);
+    if (!recs) return 1;
+    uint64_t first = h.head > h.records ? h.head - h.records + 1 : 1;
+    printf("# %llu events recorded, %zu kept, %llu overwritten\n", (unsigned long long)h.head, kept, (unsigned long long)(first - 1));
+    for (size_t i = 0; i < kept; ++i) print_rec(&h, &recs[i]);
+    free(recs);
+    return 0;
+}
@@ -5,6 +5,44 @@ static void free_str(char **p) {
     if (p && *p) { free(*p); *p = NULL; }
 }
 
+int c4a_pidset_push(C4aPidSet *s, pid_t pid, uint64_t start) {
+    int cap = s->heap ? s->cap : C4A_PIDSET_INLINE;
+    if (s->len == cap) {
+        int ncap = cap * 2;
+        C4aProcRef *nh = realloc(s->heap, (size_t)ncap * sizeof(C4aProcRef));
+        if (!nh) return -1;
+        if (!s->heap) memcpy(nh, s->small, (size_t)s->len * sizeof(C4aProcRef));
+        s->heap = nh;
+        s->cap = ncap;
+    }
+    C4aProcRef *it = c4a_pidset_items(s);
+    it[s->len].pid = pid;
+    it[s->len].start = start;
+    s->len++;
+    return 0;
+}
+
+int c4a_pidset_find(const C4aPidSet *s, pid_t pid) {
+    const C4aProcRef *it = c4a_pidset_citems(s);
+    for (int i = 0; i < s->len; ++i) {
+        if (it[i].pid == pid) return i;
+    }
+    return -1;
+}
+
+void c4a_pidset_remove_at(C4aPidSet *s, int idx) {
+    if (idx < 0 || idx >= s->len) return;
+    C4aProcRef *it = c4a_pidset_items(s);
+    it[idx] = it[--s->len];
+}
+
+void c4a_pidset_free(C4aPidSet *s) {
+    free(s->heap);
+    s->heap = NULL;
+    s->cap = 0;
+    s->len = 0;
+}
+
 void c4a_free_app(C4aApp *app) {
     if (!app) return;
     free_str(&app->settings.unique_id);
@@ -16,6 +54,10 @@ void c4a_free_app(C4aApp *app) {
     free_str(&app->memory.date_time_of_last_free_open);
     free_str(&app->memory.last_open_time);
     free_str(&app->memory.last_burned_date_time);
+    if (app->trigger_re_state == 1) regfree(&app->trigger_re);
+    c4a_pidset_free(&app->pids);
+    c4a_pidset_free(&app->frozen);
+    if (app->task.state == C4A_TASK_RUNNING && app->task.pidfd >= 0) close(app->task.pidfd);
     free(app);
 }
 
@@ -5,6 +5,25 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <sys/types.h>
+#include <regex.h>
+
+#ifndef C4A_PIDSET_INLINE
+#define C4A_PIDSET_INLINE 8
+#endif
+
+typedef struct {
+    pid_t pid;
+    uint64_t start; // start time, guards against pid reuse (0 = unknown)
+} C4aProcRef;
+
+// Growable pid set. Small sets live inline; larger ones spill to the heap and
+// keep their capacity, so refilling it every tick does not allocate.
+typedef struct {
+    int len;
+    int cap;            // heap capacity, 0 while inline
+    C4aProcRef *heap;
+    C4aProcRef small[C4A_PIDSET_INLINE];
+} C4aPidSet;
 
 typedef struct {
     int cycle_frequency_in_seconds;
@@ -45,6 +64,7 @@ typedef struct {
     int can_recover_from_conbustion_possible;
     double conbustion_temp;
     int recovery_length_in_hours_from_conbustion;
+    double trigger_timeout_in_seconds; // probe deadline, 0 = C4A_EXTERNAL_TIMEOUT_SECONDS
     char *group_key; // filename of sqlv
 } C4aAppSettings;
 
@@ -65,24 +85,72 @@ typedef struct {
     char *last_burned_date_time;
 } C4aAppMemory;
 
+// Challenge supervision (tasks.c): a launched challenge runs beside the tick
+// loop and its result is applied once it has exited.
+typedef enum {
+    C4A_TASK_IDLE = 0,
+    C4A_TASK_RUNNING,
+    C4A_TASK_FINISHED
+} C4aTaskState;
+
+typedef struct {
+    C4aTaskState state;
+    pid_t pid;
+    int pidfd;              // readable once the child exits; -1 if unsupported
+    double started_mono;
+    int passed;             // valid once FINISHED
+    int early_exit;
+} C4aTask;
+
+typedef struct C4aStoreDb C4aStoreDb;
+
 typedef struct {
     C4aAppSettings settings;
     C4aAppMemory memory;
+    C4aStoreDb *store;       // open memory database, owned by c4a_store.c
+    uint64_t stored_hash;    // image of the memory as last stored (c4a_store.c)
+    unsigned stored_gen;     // 0 = nothing known stored
     int allowed;
-    int pids_len;
-    pid_t pids[64];
+    C4aPidSet pids;
     int is_running;
     double allowed_since_mono;
     double last_burn_check_mono;
     double last_warn_mono;
+    double next_step_mono;   // when the next heating/cooling step is due
+    int last_running;        // is_running as last observed, applied to the steps up to now
+    unsigned samples;        // detection samples since the last step (guard_sample)
+    unsigned samples_running;
+    regex_t trigger_re;      // compiled name/command trigger (detection.c)
+    int trigger_re_state;    // 0 = not compiled, 1 = ready, -1 = invalid pattern
+    C4aTask task;
+    C4aPidSet frozen;        // processes held stopped while a challenge runs
+    double frozen_since_mono;
+    int cgroup;              // 1 while the app has a cgroup (c4a_cgroup.c)
+    int cgroup_frozen;
+    int cgroup_strays;       // detected pids that could not be moved into it
 } C4aApp;
 
+typedef struct C4aClock C4aClock;
+
 typedef struct {
     C4aGlobalSettings globals;
     C4aApp **apps;
     size_t app_count;
+    C4aClock *clock;         // time source for the tick, NULL = real (c4a_clock.h)
+    int simulated;           // replay (c4a_replay.h): no signals, launches, writes or commands
 } C4aContext;
 
+static inline C4aProcRef *c4a_pidset_items(C4aPidSet *s) {
+    return s->heap ? s->heap : s->small;
+}
+static inline const C4aProcRef *c4a_pidset_citems(const C4aPidSet *s) {
+    return s->heap ? s->heap : s->small;
+}
+int c4a_pidset_push(C4aPidSet *s, pid_t pid, uint64_t start);
+int c4a_pidset_find(const C4aPidSet *s, pid_t pid);
+void c4a_pidset_remove_at(C4aPidSet *s, int idx);
+void c4a_pidset_free(C4aPidSet *s);
+
 void c4a_free_app(C4aApp *app);
 void c4a_free_context(C4aContext *ctx);
 C4aContext *c4a_context_new(void);
@@ -56,6 +56,111 @@
 #ifndef REQUESTS_DB_PATH
 #define REQUESTS_DB_PATH "/opt/c4a/protected/com/requests.sqlite"
 #endif
+#ifndef C4A_EXTERNAL_WORKERS
+#define C4A_EXTERNAL_WORKERS 4
+#endif
+#ifndef C4A_EXTERNAL_TIMEOUT_SECONDS
+#define C4A_EXTERNAL_TIMEOUT_SECONDS 5.0
+#endif
+#ifndef C4A_EXTERNAL_TTL_SECONDS
+#define C4A_EXTERNAL_TTL_SECONDS 10.0
+#endif
+#ifndef C4A_EXTERNAL_JOIN_MS
+#define C4A_EXTERNAL_JOIN_MS 1000
+#endif
+#ifndef C4A_KILL_GRACE_SECONDS
+#define C4A_KILL_GRACE_SECONDS 1.0
+#endif
+#ifndef C4A_GATE_FREEZE
+#define C4A_GATE_FREEZE 0
+#endif
+#ifndef C4A_GATE_FREEZE_TIMEOUT_SECONDS
+#define C4A_GATE_FREEZE_TIMEOUT_SECONDS 600.0
+#endif
+#ifndef C4A_FREEZE_STATE_FILE
+#define C4A_FREEZE_STATE_FILE GLOBAL_MEMORIES_DIR "/frozen_pids"
+#endif
+#ifndef C4A_FREEZE_MAX_HELD
+#define C4A_FREEZE_MAX_HELD 4096
+#endif
+#ifndef C4A_CGROUP_ROOT
+#define C4A_CGROUP_ROOT "/sys/fs/cgroup/c4a"
+#endif
+#ifndef C4A_CGROUP_MAX_FROZEN
+#define C4A_CGROUP_MAX_FROZEN 256
+#endif
+#ifndef C4A_TEMPERATURE_STEP_SECONDS
+#define C4A_TEMPERATURE_STEP_SECONDS 60.0
+#endif
+#ifndef C4A_SAMPLE_SECONDS
+#define C4A_SAMPLE_SECONDS 1.0
+#endif
+#ifndef C4A_METRICS_FILE
+#define C4A_METRICS_FILE GLOBAL_MEMORIES_DIR "/guard_metrics.prom"
+#endif
+#ifndef C4A_METRICS_INTERVAL_SECONDS
+#define C4A_METRICS_INTERVAL_SECONDS 60.0
+#endif
+#ifndef C4A_TRACE_FILE
+#define C4A_TRACE_FILE GLOBAL_MEMORIES_DIR "/guard_trace.bin"
+#endif
+#ifndef C4A_TRACE_RECORDS
+#define C4A_TRACE_RECORDS 8192
+#endif
+#ifndef C4A_TRACE_CHECKPOINTS
+#define C4A_TRACE_CHECKPOINTS 4
+#endif
+#ifndef C4A_TRACE_STATE_APPS
+#define C4A_TRACE_STATE_APPS 256
+#endif
+#ifndef C4A_TIME_SYNC_URLS
+#define C4A_TIME_SYNC_URLS "https://www.google.com https://www.apple.com https://www.cloudflare.com"
+#endif
+#ifndef C4A_TIME_SYNC_INTERVAL_SECONDS
+#define C4A_TIME_SYNC_INTERVAL_SECONDS 3600
+#endif
+#ifndef C4A_TIME_SYNC_RETRY_SECONDS
+#define C4A_TIME_SYNC_RETRY_SECONDS 300
+#endif
+#ifndef C4A_TIME_OFFSET_FILE
+#define C4A_TIME_OFFSET_FILE GLOBAL_MEMORIES_DIR "/time_offset"
+#endif
+#define C4A_STORE_PER_APP 0
+#define C4A_STORE_CONSOLIDATED 1
+#define C4A_STORE_JOURNAL 2
+#ifndef C4A_STORE_BACKEND
+#define C4A_STORE_BACKEND C4A_STORE_PER_APP
+#endif
+#ifndef C4A_MEMORY_DB_FILE
+#define C4A_MEMORY_DB_FILE GLOBAL_MEMORIES_DIR "/app_memories.sqlite"
+#endif
+#ifndef C4A_JOURNAL_FILE
+#define C4A_JOURNAL_FILE GLOBAL_MEMORIES_DIR "/app_memories.journal"
+#endif
+#ifndef C4A_JOURNAL_SNAPSHOT_FILE
+#define C4A_JOURNAL_SNAPSHOT_FILE GLOBAL_MEMORIES_DIR "/app_memories.snapshot"
+#endif
+#ifndef C4A_JOURNAL_COMPACT_BYTES
+#define C4A_JOURNAL_COMPACT_BYTES (1024 * 1024)
+#endif
+#ifndef C4A_STORE_WRITE_BEHIND
+#define C4A_STORE_WRITE_BEHIND 1
+#endif
+#ifndef C4A_WRITER_QUEUE
+#define C4A_WRITER_QUEUE 1024
+#endif
+#ifndef C4A_WRITER_FLUSH_RECORDS
+#define C4A_WRITER_FLUSH_RECORDS 256
+#endif
+#ifndef C4A_WRITER_FLUSH_SECONDS
+#define C4A_WRITER_FLUSH_SECONDS 1.0
+#endif
+#ifndef C4A_SCHED_SLACK_SECONDS
+#define C4A_SCHED_SLACK_SECONDS 1.0
+#endif
+#ifndef C4A_IDLE_WAKE_SECONDS
+#define C4A_IDLE_WAKE_SECONDS 300
+#endif
 #ifndef BURN_WARNING_RATIO
 #define BURN_WARNING_RATIO 0.9
 #endif
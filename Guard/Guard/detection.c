@@ -1,6 +1,8 @@
 #include "include.h"
 #include <strings.h>
 #include "detection.h"
+#include "c4a_match.h"
+#include "c4a_external.h"
 
 static const char *fallback_script_paths[] = {
     "/opt/c4a/bin/pcheck.sh",
@@ -9,7 +11,7 @@ static const char *fallback_script_paths[] = {
     NULL
 };
 
-static int find_script(char *buf, size_t buflen) {
+int c4a_pcheck_path(char *buf, size_t buflen) {
     for (int i = 0; fallback_script_paths[i]; ++i) {
         if (access(fallback_script_paths[i], X_OK) == 0) {
             snprintf(buf, buflen, "%s", fallback_script_paths[i]);
@@ -22,10 +24,10 @@ static int find_script(char *buf, size_t buflen) {
     return -1;
 }
 
-static int call_pcheck(const char *mode, const char *data, pid_t *out, int max, int *count_out) {
-    *count_out = 0;
+static int call_pcheck(const char *mode, const char *data, C4aPidSet *out) {
+    out->len = 0;
     char spath[PATH_MAX] = {0};
-    if (find_script(spath, sizeof(spath)) != 0) return 0;
+    if (c4a_pcheck_path(spath, sizeof(spath)) != 0) return 0;
     char cmd[4096];
     snprintf(cmd, sizeof(cmd), "\"%s\" %s \"%s\"", spath, mode, data ? data : "");
     FILE *fp = popen(cmd, "r");
@@ -34,36 +36,721 @@ static int call_pcheck(const char *mode, const char *data, pid_t *out, int max,
     while (fgets(line, sizeof(line), fp) != NULL) {
         char *end = NULL;
         long v = strtol(line, &end, 10);
-        if (end == line) continue;
-        if (*count_out < max) out[(*count_out)++] = (pid_t)v;
+        if (end == line || v <= 0) continue;
+        c4a_pidset_push(out, (pid_t)v, c4a_proc_start_time((pid_t)v));
     }
     pclose(fp);
     return 0;
 }
 
-int c4a_detect_pids_for_app(const C4aApp *app, pid_t *out, int max, int *count_out) {
-    if (!app || !app->settings.trigger_id_type) { *count_out = 0; return 0; }
+#ifdef __linux__
+// Single /proc snapshot shared by every name/command trigger in a tick.
+// Buffers are kept between ticks so a steady-state scan does not allocate.
+typedef struct {
+    pid_t pid;
+    uint64_t start;   // starttime from /proc/<pid>/stat, 0 if unknown
+    char comm[32];
+    size_t cmd_off;   // offset of NUL-terminated cmdline in g_snap.text
+    size_t cmd_len;
+    long cached;      // slot in g_pcache holding last tick's result, -1 if new
+} C4aProcEntry;
+
+static struct {
+    C4aProcEntry *procs;
+    size_t len, cap;
+    char *text;
+    size_t text_len, text_cap;
+} g_snap;
+
+// Match results from the previous tick keyed by (pid, starttime). A process
+// that is still there with the same identity reuses its result, so cmdline
+// reads and pattern matching only happen for processes that are new. The table
+// is rebuilt into g_pcache_next each tick and the two are swapped, which keeps
+// eviction simple and allocation-free in steady state.
+typedef struct {
+    pid_t pid;        // 0 = empty slot
+    uint64_t start;
+    char comm[32];    // exec keeps pid and start time but (almost always) changes comm
+    int nids, cap_ids;
+    int *ids;         // indices into ctx->apps that matched
+} C4aPidCacheEntry;
+
+typedef struct {
+    C4aPidCacheEntry *slots;
+    size_t cap;       // power of two
+    size_t count;
+} C4aPidTable;
+
+static C4aPidTable g_pcache, g_pcache_next;
+
+static size_t pid_hash(pid_t pid, size_t cap) {
+    return ((uint32_t)pid * 2654435761u) & (cap - 1);
+}
+
+static long pcache_find(const C4aPidTable *t, pid_t pid) {
+    if (!t->cap) return -1;
+    for (size_t h = pid_hash(pid, t->cap);; h = (h + 1) & (t->cap - 1)) {
+        if (t->slots[h].pid == 0) return -1;
+        if (t->slots[h].pid == pid) return (long)h;
+    }
+}
+
+static int pcache_reserve(C4aPidTable *t, size_t count) {
+    if (count * 2 <= t->cap) return 0;
+    size_t ncap = t->cap ? t->cap : 1024;
+    while (count * 2 > ncap) ncap *= 2;
+    C4aPidCacheEntry *ns = calloc(ncap, sizeof(C4aPidCacheEntry));
+    if (!ns) return -1;
+    for (size_t i = 0; i < t->cap; ++i) {
+        if (t->slots[i].pid == 0) continue;
+        size_t h = pid_hash(t->slots[i].pid, ncap);
+        while (ns[h].pid != 0) h = (h + 1) & (ncap - 1);
+        ns[h] = t->slots[i];
+    }
+    free(t->slots);
+    t->slots = ns; t->cap = ncap;
+    return 0;
+}
+
+static C4aPidCacheEntry *pcache_insert(C4aPidTable *t, pid_t pid) {
+    if (pcache_reserve(t, t->count + 1) != 0) return NULL;
+    size_t h = pid_hash(pid, t->cap);
+    while (t->slots[h].pid != 0 && t->slots[h].pid != pid) h = (h + 1) & (t->cap - 1);
+    if (t->slots[h].pid == 0) t->count++;
+    t->slots[h].pid = pid;
+    return &t->slots[h];
+}
+
+static void pcache_clear(C4aPidTable *t) {
+    for (size_t i = 0; i < t->cap; ++i) {
+        if (t->slots[i].pid != 0) free(t->slots[i].ids);
+    }
+    if (t->cap) memset(t->slots, 0, t->cap * sizeof(C4aPidCacheEntry));
+    t->count = 0;
+}
+
+static int pcache_add_id(C4aPidCacheEntry *ce, int id) {
+    if (ce->nids == ce->cap_ids) {
+        int ncap = ce->cap_ids ? ce->cap_ids * 2 : 2;
+        int *ni = realloc(ce->ids, (size_t)ncap * sizeof(int));
+        if (!ni) return -1;
+        ce->ids = ni; ce->cap_ids = ncap;
+    }
+    ce->ids[ce->nids++] = id;
+    return 0;
+}
+
+static ssize_t read_small_file(const char *path, char *buf, size_t buflen) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, buflen - 1);
+    close(fd);
+    if (n < 0) return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+// Reads comm, ppid (field 4) and starttime (field 22) from /proc/<pid>/stat.
+// comm may itself contain spaces and parentheses, so fields are located from
+// the last ')'.
+static int read_proc_stat(pid_t pid, char *comm, size_t commlen, pid_t *ppid, uint64_t *start) {
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    ssize_t n = read_small_file(path, buf, sizeof(buf));
+    if (n <= 0) return -1;
+    char *lp = strchr(buf, '(');
+    char *rp = strrchr(buf, ')');
+    if (!lp || !rp || rp < lp) return -1;
+    if (comm) {
+        size_t cl = (size_t)(rp - lp - 1);
+        if (cl >= commlen) cl = commlen - 1;
+        memcpy(comm, lp + 1, cl);
+        comm[cl] = '\0';
+    }
+    // rp + 2 is field 3 (state); ppid follows it, starttime is 19 fields on.
+    char *p = rp + 2;
+    if (ppid) {
+        char *q = strchr(p, ' ');
+        *ppid = q ? (pid_t)strtol(q + 1, NULL, 10) : 0;
+    }
+    for (int f = 3; f < 22 && *p; ++f) {
+        p = strchr(p, ' ');
+        if (!p) return -1;
+        p++;
+    }
+    if (start) *start = strtoull(p, NULL, 10);
+    return 0;
+}
+
+uint64_t c4a_proc_start_time(pid_t pid) {
+    uint64_t st = 0;
+    if (pid <= 0 || read_proc_stat(pid, NULL, 0, NULL, &st) != 0) return 0;
+    return st;
+}
+
+int c4a_proc_parent(pid_t pid, pid_t *ppid, uint64_t *start) {
+    if (pid <= 0) return -1;
+    return read_proc_stat(pid, NULL, 0, ppid, start);
+}
+
+typedef struct {
+    pid_t pid;
+    pid_t ppid;
+    uint64_t start;
+} C4aProcLink;
+
+static struct {
+    C4aProcLink *v;
+    size_t len, cap;
+} g_links;
+
+static int scan_links(void) {
+    DIR *d = opendir("/proc");
+    if (!d) return -1;
+    g_links.len = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (!isdigit((unsigned char)de->d_name[0])) continue;
+        pid_t pid = (pid_t)strtol(de->d_name, NULL, 10);
+        pid_t ppid = 0;
+        uint64_t start = 0;
+        if (read_proc_stat(pid, NULL, 0, &ppid, &start) != 0) continue;
+        if (g_links.len == g_links.cap) {
+            size_t ncap = g_links.cap ? g_links.cap * 2 : 512;
+            C4aProcLink *nv = realloc(g_links.v, ncap * sizeof(C4aProcLink));
+            if (!nv) break;
+            g_links.v = nv; g_links.cap = ncap;
+        }
+        g_links.v[g_links.len++] = (C4aProcLink){ pid, ppid, start };
+    }
+    closedir(d);
+    return 0;
+}
+
+int c4a_proc_descendants(const C4aPidSet *roots, C4aPidSet *out) {
+    if (roots->len == 0) return 0;
+    if (scan_links() != 0) return -1;
+    int grew = 1;
+    while (grew) {
+        grew = 0;
+        for (size_t i = 0; i < g_links.len; ++i) {
+            const C4aProcLink *l = &g_links.v[i];
+            if (c4a_pidset_find(roots, l->pid) >= 0 || c4a_pidset_find(out, l->pid) >= 0) continue;
+            if (c4a_pidset_find(roots, l->ppid) < 0 && c4a_pidset_find(out, l->ppid) < 0) continue;
+            c4a_pidset_push(out, l->pid, l->start);
+            grew = 1;
+        }
+    }
+    return 0;
+}
+
+static int snap_reserve_text(size_t extra) {
+    if (g_snap.text_len + extra <= g_snap.text_cap) return 0;
+    size_t ncap = g_snap.text_cap ? g_snap.text_cap : 65536;
+    while (ncap < g_snap.text_len + extra) ncap *= 2;
+    char *nt = realloc(g_snap.text, ncap);
+    if (!nt) return -1;
+    g_snap.text = nt; g_snap.text_cap = ncap;
+    return 0;
+}
+
+// Appends the cmdline of pid to the text arena with argv separators turned
+// into spaces, matching what `pgrep -f` matches against. Kernel threads have an
+// empty cmdline; fall back to the process name like pgrep does. Returns -1
+// when the arena cannot grow; e then keeps the empty string at offset 0.
+static int snap_add_cmdline(C4aProcEntry *e, pid_t pid, const char *comm) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/cmdline", (int)pid);
+    size_t off = g_snap.text_len;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    size_t got = 0;
+    if (fd >= 0) {
+        for (;;) {
+            // Relative to off: the arena only grows past off once we return.
+            if (snap_reserve_text(got + 4096) != 0) {
+                // A truncated cmdline could miss or wrongly match a trigger.
+                close(fd);
+                e->cmd_off = 0;
+                e->cmd_len = 0;
+                return -1;
+            }
+            ssize_t n = read(fd, g_snap.text + off + got, g_snap.text_cap - off - got - 1);
+            if (n <= 0) break;
+            got += (size_t)n;
+        }
+        close(fd);
+    }
+    if (got == 0) {
+        size_t cl = strlen(comm);
+        if (snap_reserve_text(cl + 1) != 0) {
+            e->cmd_off = 0;
+            e->cmd_len = 0;
+            return -1;
+        }
+        memcpy(g_snap.text + off, comm, cl);
+        got = cl;
+    }
+    while (got > 0 && g_snap.text[off + got - 1] == '\0') got--;
+    for (size_t i = 0; i < got; ++i) {
+        if (g_snap.text[off + i] == '\0') g_snap.text[off + i] = ' ';
+    }
+    g_snap.text[off + got] = '\0';
+    g_snap.text_len = off + got + 1;
+    e->cmd_off = off;
+    e->cmd_len = got;
+    return 0;
+}
+
+static const C4aProcInfo *g_proc_table = NULL;
+static size_t g_proc_table_len = 0;
+
+void c4a_detect_set_proc_table(const C4aProcInfo *procs, size_t n) {
+    g_proc_table = procs;
+    g_proc_table_len = procs ? n : 0;
+}
+
+static long snap_cached_slot(pid_t pid, uint64_t start, const char *comm) {
+    if (start == 0) return -1;
+    long slot = pcache_find(&g_pcache, pid);
+    if (slot < 0) return -1;
+    const C4aPidCacheEntry *ce = &g_pcache.slots[slot];
+    if (ce->start != start || strncmp(ce->comm, comm, sizeof(ce->comm) - 1) != 0) return -1;
+    return slot;
+}
+
+static C4aProcEntry *snap_push(pid_t pid, uint64_t start, const char *comm) {
+    if (g_snap.len == g_snap.cap) {
+        size_t ncap = g_snap.cap ? g_snap.cap * 2 : 512;
+        C4aProcEntry *np = realloc(g_snap.procs, ncap * sizeof(C4aProcEntry));
+        if (!np) return NULL;
+        g_snap.procs = np; g_snap.cap = ncap;
+    }
+    C4aProcEntry *e = &g_snap.procs[g_snap.len++];
+    e->pid = pid;
+    e->start = start;
+    snprintf(e->comm, sizeof(e->comm), "%s", comm);
+    e->cmd_off = 0; e->cmd_len = 0;
+    e->cached = snap_cached_slot(pid, start, comm);
+    return e;
+}
+
+static int snap_from_table(int want_cmdline) {
+    for (size_t i = 0; i < g_proc_table_len; ++i) {
+        const C4aProcInfo *pi = &g_proc_table[i];
+        C4aProcEntry *e = snap_push(pi->pid, pi->start, pi->comm ? pi->comm : "");
+        if (!e) return -1;
+        if (want_cmdline && e->cached < 0) {
+            const char *cl = pi->cmdline && *pi->cmdline ? pi->cmdline : e->comm;
+            size_t n = strlen(cl);
+            if (snap_reserve_text(n + 1) != 0) return -1;
+            e->cmd_off = g_snap.text_len;
+            memcpy(g_snap.text + e->cmd_off, cl, n + 1);
+            g_snap.text_len += n + 1;
+            e->cmd_len = n;
+        }
+    }
+    return 0;
+}
+
+static int take_proc_snapshot(int want_cmdline) {
+    g_snap.len = 0;
+    g_snap.text_len = 0;
+    if (snap_reserve_text(1) != 0) return -1;
+    g_snap.text[g_snap.text_len++] = '\0'; // offset 0 is the empty string
+    if (g_proc_table) return snap_from_table(want_cmdline);
+    DIR *d = opendir("/proc");
+    if (!d) return -1;
+    pid_t self = getpid();
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        const char *nm = ent->d_name;
+        if (*nm < '1' || *nm > '9') continue;
+        char *end = NULL;
+        long v = strtol(nm, &end, 10);
+        if (!end || *end != '\0' || v <= 0) continue;
+        pid_t pid = (pid_t)v;
+        if (pid == self) continue;
+        char comm[32];
+        uint64_t start = 0;
+        if (read_proc_stat(pid, comm, sizeof(comm), NULL, &start) != 0) continue; // exited while scanning
+        C4aProcEntry *e = snap_push(pid, start, comm);
+        if (!e) break;
+        if (want_cmdline && e->cached < 0) {
+            snap_add_cmdline(e, pid, comm);
+        }
+    }
+    closedir(d);
+    return 0;
+}
+
+// Compiles the app's trigger pattern once. pgrep treats its pattern as an
+// extended regular expression, so we do the same.
+static int app_trigger_re(C4aApp *app) {
+    if (app->trigger_re_state == 0) {
+        const char *data = app->settings.trigger_id_data ? app->settings.trigger_id_data : "";
+        if (regcomp(&app->trigger_re, data, REG_EXTENDED | REG_NOSUB) == 0) {
+            app->trigger_re_state = 1;
+        } else {
+            syslog(LOG_WARNING, "Invalid trigger pattern for %s: %s", app->settings.unique_id ?: "app", data);
+            app->trigger_re_state = -1;
+        }
+    }
+    return app->trigger_re_state == 1 ? 0 : -1;
+}
+
+// 1 = name trigger, 2 = command trigger, 0 = anything else
+static int native_trigger_kind(const C4aApp *app) {
     const char *type = app->settings.trigger_id_type;
-    const char *data = app->settings.trigger_id_data ? app->settings.trigger_id_data : "";
-    if (strcasecmp(type, "name") == 0) return call_pcheck("name", data, out, max, count_out);
-    if (strcasecmp(type, "command") == 0) return call_pcheck("command", data, out, max, count_out);
-    if (strcasecmp(type, "external") == 0) return call_pcheck("external", data, out, max, count_out);
-    if (strcasecmp(type, "url") == 0) { *count_out = 0; return 0; }
-    *count_out = 0; return 0;
+    if (!type) return 0;
+    if (strcasecmp(type, "name") == 0) return 1;
+    if (strcasecmp(type, "command") == 0) return 2;
+    return 0;
+}
+
+static int app_matches(C4aApp *app, int kind, const char *comm, const char *cmdline) {
+    if (app_trigger_re(app) != 0) return 0;
+    const char *subject = kind == 1 ? comm : cmdline;
+    return regexec(&app->trigger_re, subject, 0, NULL, 0) == 0;
+}
+
+// Live mode: a process event source (c4a_procev.c) keeps app->pids current for
+// name/command triggers, so the tick can skip the /proc walk.
+static int g_live = 0;
+static int g_need_rescan = 1;
+
+static int app_has_pid(const C4aApp *app, pid_t pid) {
+    return c4a_pidset_find(&app->pids, pid) >= 0;
+}
+
+static int app_drop_pid(C4aApp *app, pid_t pid) {
+    int k = c4a_pidset_find(&app->pids, pid);
+    if (k < 0) return 0;
+    c4a_pidset_remove_at(&app->pids, k);
+    app->is_running = (app->pids.len > 0);
+    return 1;
+}
+
+static int app_add_pid(C4aApp *app, pid_t pid, uint64_t start) {
+    if (app_has_pid(app, pid) || c4a_pidset_push(&app->pids, pid, start) != 0) return 0;
+    app->is_running = 1;
+    return 1;
+}
+
+// An app that is running without permission needs enforcement right away.
+static int app_needs_enforcement(const C4aApp *app) {
+    return !app->allowed || app->settings.always_blocked || app->memory.burned || app->memory.burned_forever;
+}
+
+// Compiled rule set for the loaded apps. Command triggers contribute the
+// literal every match must contain to one Aho-Corasick automaton, so a cmdline
+// is scanned once for all of them; the regex only runs to confirm a hit when
+// the pattern is not a plain literal. Command patterns without a required
+// literal (e.g. alternations) and name triggers are matched by regex.
+static struct {
+    const C4aContext *ctx;
+    size_t app_count;
+    C4aMatcher *cmd;
+    unsigned char *exact;      // per app index: literal hit is a full match
+    size_t *name_apps, n_name;
+    size_t *slow_apps, n_slow;
+    int multipattern;
+} g_rules = { .multipattern = 1 };
+
+static void rules_reset(void) {
+    c4a_matcher_free(g_rules.cmd); g_rules.cmd = NULL;
+    free(g_rules.exact); g_rules.exact = NULL;
+    free(g_rules.name_apps); g_rules.name_apps = NULL; g_rules.n_name = 0;
+    free(g_rules.slow_apps); g_rules.slow_apps = NULL; g_rules.n_slow = 0;
+    g_rules.ctx = NULL; g_rules.app_count = 0;
+}
+
+static int ensure_rules(C4aContext *ctx) {
+    if (g_rules.ctx == ctx && g_rules.app_count == ctx->app_count) return 0;
+    return c4a_detect_compile(ctx);
 }
 
-int c4a_kill_pids(pid_t *pids, int n) {
-    int killed = 0;
-    for (int i = 0; i < n; ++i) {
-        if (pids[i] <= 1) continue;
-        if (kill(pids[i], SIGTERM) == 0) killed++;
+typedef struct {
+    C4aContext *ctx;
+    pid_t pid;
+    uint64_t start;
+    const char *cmdline;
+    C4aPidCacheEntry *cache;  // collects matched app indices, may be NULL
+    int live;
+    int due;
+} C4aMatchArgs;
+
+static void record_match(C4aMatchArgs *ma, int id) {
+    C4aApp *app = ma->ctx->apps[id];
+    if (ma->cache) pcache_add_id(ma->cache, id);
+    if (ma->live) {
+        if (app_add_pid(app, ma->pid, ma->start) && app_needs_enforcement(app)) ma->due = 1;
+    } else {
+        c4a_pidset_push(&app->pids, ma->pid, ma->start);
+    }
+}
+
+static void on_cmd_hit(int id, void *arg) {
+    C4aMatchArgs *ma = arg;
+    if (!g_rules.exact[id] && !app_matches(ma->ctx->apps[id], 2, NULL, ma->cmdline)) return;
+    record_match(ma, id);
+}
+
+static void match_process(C4aMatchArgs *ma, const char *comm, const char *cmdline, size_t cmd_len) {
+    C4aApp **apps = ma->ctx->apps;
+    for (size_t k = 0; k < g_rules.n_name; ++k) {
+        size_t id = g_rules.name_apps[k];
+        if (app_matches(apps[id], 1, comm, NULL)) record_match(ma, (int)id);
+    }
+    ma->cmdline = cmdline;
+    if (g_rules.cmd) c4a_matcher_scan(g_rules.cmd, cmdline, cmd_len, on_cmd_hit, ma);
+    for (size_t k = 0; k < g_rules.n_slow; ++k) {
+        size_t id = g_rules.slow_apps[k];
+        if (app_matches(apps[id], 2, NULL, cmdline)) record_match(ma, (int)id);
+    }
+}
+
+// Matches the snapshot against the rules, reusing last tick's result for
+// every process whose (pid, starttime, comm) is unchanged.
+static void match_snapshot(C4aContext *ctx) {
+    C4aPidTable *next = &g_pcache_next;
+    pcache_clear(next);
+    pcache_reserve(next, g_snap.len);
+    C4aMatchArgs ma = { .ctx = ctx, .live = 0 };
+    for (size_t k = 0; k < g_snap.len; ++k) {
+        const C4aProcEntry *e = &g_snap.procs[k];
+        ma.pid = e->pid;
+        ma.start = e->start;
+        if (e->cached >= 0) {
+            C4aPidCacheEntry *old = &g_pcache.slots[e->cached];
+            C4aPidCacheEntry *ce = pcache_insert(next, e->pid);
+            if (ce) {
+                *ce = *old;
+                old->ids = NULL; old->nids = 0; old->cap_ids = 0; // moved
+            }
+            const C4aPidCacheEntry *src = ce ? ce : old;
+            ma.cache = NULL;
+            for (int j = 0; j < src->nids; ++j) record_match(&ma, src->ids[j]);
+            continue;
+        }
+        ma.cache = NULL;
+        if (e->start != 0) {
+            ma.cache = pcache_insert(next, e->pid);
+            if (ma.cache) {
+                ma.cache->start = e->start;
+                snprintf(ma.cache->comm, sizeof(ma.cache->comm), "%s", e->comm);
+                ma.cache->nids = 0;
+            }
+        }
+        match_process(&ma, e->comm, g_snap.text + e->cmd_off, e->cmd_len);
     }
-    sleep(1);
-    for (int i = 0; i < n; ++i) {
-        if (pids[i] <= 1) continue;
-        kill(pids[i], SIGKILL);
+    // Whatever was not carried over belongs to processes that are gone.
+    pcache_clear(&g_pcache);
+    C4aPidTable tmp = g_pcache; g_pcache = g_pcache_next; g_pcache_next = tmp;
+}
+
+void c4a_detect_set_live(int live) {
+    g_live = live;
+    g_need_rescan = 1;
+}
+
+void c4a_detect_request_rescan(void) {
+    g_need_rescan = 1;
+}
+
+int c4a_detect_note_exec(C4aContext *ctx, pid_t pid) {
+    if (!ctx || pid == getpid()) return 0;
+    char comm[32];
+    uint64_t start = 0;
+    if (read_proc_stat(pid, comm, sizeof(comm), NULL, &start) != 0) { c4a_detect_note_exit(ctx, pid); return 0; }
+    // The cached result describes the old image.
+    long slot = pcache_find(&g_pcache, pid);
+    if (slot >= 0) g_pcache.slots[slot].start = 0;
+    if (ensure_rules(ctx) != 0) return 0;
+    // Read to EOF like a full scan, past the end of the snapshot's text; the
+    // snapshot gets its arena back afterwards.
+    if (g_snap.text_len == 0) {
+        if (snap_reserve_text(1) != 0) return 0;
+        g_snap.text[g_snap.text_len++] = '\0';
     }
-    return killed;
+    size_t mark = g_snap.text_len;
+    C4aProcEntry e = { .pid = pid, .start = start };
+    snap_add_cmdline(&e, pid, comm);
+    // exec replaces the image, so a pid may stop matching as well as start
+    c4a_detect_note_exit(ctx, pid);
+    C4aMatchArgs ma = { .ctx = ctx, .pid = pid, .start = start, .live = 1 };
+    match_process(&ma, comm, g_snap.text + e.cmd_off, e.cmd_len);
+    g_snap.text_len = mark;
+    return ma.due;
+}
+
+int c4a_detect_note_fork(C4aContext *ctx, pid_t parent, pid_t child) {
+    if (!ctx) return 0;
+    int due = 0;
+    uint64_t start = 0;
+    for (size_t i = 0; i < ctx->app_count; ++i) {
+        C4aApp *app = ctx->apps[i];
+        if (!native_trigger_kind(app) || !app_has_pid(app, parent)) continue;
+        if (start == 0) start = c4a_proc_start_time(child);
+        if (app_add_pid(app, child, start) && app_needs_enforcement(app)) due = 1;
+    }
+    return due;
+}
+
+void c4a_detect_note_exit(C4aContext *ctx, pid_t pid) {
+    if (!ctx) return;
+    for (size_t i = 0; i < ctx->app_count; ++i) {
+        C4aApp *app = ctx->apps[i];
+        if (native_trigger_kind(app)) app_drop_pid(app, pid);
+    }
+}
+#endif
+
+int c4a_detect_compile(C4aContext *ctx) {
+    if (!ctx) return -1;
+#ifdef __linux__
+    rules_reset();
+    // Cached results hold app indices from the previous rule set.
+    pcache_clear(&g_pcache);
+    pcache_clear(&g_pcache_next);
+    size_t n = ctx->app_count;
+    g_rules.exact = calloc(n ? n : 1, 1);
+    g_rules.name_apps = malloc((n ? n : 1) * sizeof(size_t));
+    g_rules.slow_apps = malloc((n ? n : 1) * sizeof(size_t));
+    g_rules.cmd = c4a_matcher_new();
+    if (!g_rules.exact || !g_rules.name_apps || !g_rules.slow_apps || !g_rules.cmd) {
+        rules_reset();
+        return -1;
+    }
+    size_t n_lit = 0;
+    for (size_t i = 0; i < n; ++i) {
+        C4aApp *app = ctx->apps[i];
+        int kind = native_trigger_kind(app);
+        if (kind == 1) {
+            app_trigger_re(app);
+            g_rules.name_apps[g_rules.n_name++] = i;
+        } else if (kind == 2) {
+            char lit[1024];
+            int exact = 0;
+            size_t ll = 0;
+            if (g_rules.multipattern) {
+                ll = c4a_regex_required_literal(app->settings.trigger_id_data ? app->settings.trigger_id_data : "", lit, sizeof(lit), &exact);
+            }
+            if (ll > 0 && c4a_matcher_add(g_rules.cmd, lit, ll, (int)i) == 0) {
+                g_rules.exact[i] = (unsigned char)exact;
+                n_lit++;
+                if (!exact) app_trigger_re(app);
+            } else {
+                app_trigger_re(app);
+                g_rules.slow_apps[g_rules.n_slow++] = i;
+            }
+        }
+    }
+    if (n_lit == 0) {
+        c4a_matcher_free(g_rules.cmd);
+        g_rules.cmd = NULL;
+    } else if (c4a_matcher_build(g_rules.cmd) != 0) {
+        rules_reset();
+        return -1;
+    }
+    g_rules.ctx = ctx;
+    g_rules.app_count = n;
+    syslog(LOG_NOTICE, "Detection rules compiled: %zu name, %zu command literal, %zu command regex", g_rules.n_name, n_lit, g_rules.n_slow);
+#endif
+    return 0;
+}
+
+void c4a_detect_set_multipattern(int on) {
+#ifdef __linux__
+    g_rules.multipattern = on ? 1 : 0;
+    g_rules.ctx = NULL;
+#else
+    (void)on;
+#endif
+}
+
+// probe: run the pcheck.sh probes that are due. Without it script-backed
+// triggers keep the pool's last results.
+static int detect(C4aContext *ctx, int probe) {
+    if (!ctx) return -1;
+#ifdef __linux__
+    int have_snap = 0;
+    int use_live = g_live && !g_need_rescan;
+    if (ensure_rules(ctx) == 0 && !use_live && (g_rules.n_name || g_rules.cmd || g_rules.n_slow)) {
+        have_snap = (take_proc_snapshot(g_rules.cmd || g_rules.n_slow) == 0);
+        if (have_snap) g_need_rescan = 0;
+    }
+    if (have_snap) {
+        for (size_t i = 0; i < ctx->app_count; ++i) {
+            if (native_trigger_kind(ctx->apps[i])) ctx->apps[i]->pids.len = 0;
+        }
+        match_snapshot(ctx);
+    }
+    int native_ok = use_live || have_snap;
+#else
+    int native_ok = 0;
+#endif
+    // Script-backed triggers run concurrently, bounded by a deadline.
+    int probes = probe ? (c4a_external_refresh(ctx, native_ok) == 0) : 1;
+    for (size_t i = 0; i < ctx->app_count; ++i) {
+        C4aApp *app = ctx->apps[i];
+#ifdef __linux__
+        if (native_trigger_kind(app) && native_ok) {
+            // matched above
+        } else
+#endif
+        if (!probes || !c4a_external_result(ctx, i, &app->pids)) {
+            if (probe) c4a_detect_pids_for_app(app, &app->pids);
+        }
+        app->is_running = (app->pids.len > 0);
+    }
+    return 0;
+}
+
+int c4a_detect_all(C4aContext *ctx) {
+    return detect(ctx, 1);
+}
+
+int c4a_detect_sample(C4aContext *ctx) {
+    return detect(ctx, 0);
+}
+
+int c4a_detect_needs_polling(const C4aContext *ctx) {
+#ifdef __linux__
+    if (!g_live || g_need_rescan) return 1;
+    for (size_t i = 0; i < ctx->app_count; ++i) {
+        const C4aApp *app = ctx->apps[i];
+        if (app->settings.trigger_id_type && !native_trigger_kind(app)) return 1;
+    }
+    return 0;
+#else
+    (void)ctx;
+    return 1;
+#endif
+}
+
+int c4a_detect_pids_for_app(const C4aApp *app, C4aPidSet *out) {
+    out->len = 0;
+    if (!app || !app->settings.trigger_id_type) return 0;
+    const char *type = app->settings.trigger_id_type;
+    const char *data = app->settings.trigger_id_data ? app->settings.trigger_id_data : "";
+    if (strcasecmp(type, "name") == 0) return call_pcheck("name", data, out);
+    if (strcasecmp(type, "command") == 0) return call_pcheck("command", data, out);
+    if (strcasecmp(type, "external") == 0) return call_pcheck("external", data, out);
+    return 0;
+}
+
+#ifndef __linux__
+uint64_t c4a_proc_start_time(pid_t pid) {
+    (void)pid;
+    return 0;
+}
+#endif
+
+// A pid recorded at detection time may have exited and been reused by an
+// unrelated process; only signal it if its start time still matches.
+int c4a_proc_is(pid_t pid, uint64_t start) {
+    if (start == 0) return 1; // identity unknown on this platform
+    return c4a_proc_start_time(pid) == start;
 }
 
 int c4a_block_url(const char *pattern) {
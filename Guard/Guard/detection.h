@@ -3,8 +3,56 @@
 
 #include "c4a_types.h"
 
-int c4a_detect_pids_for_app(const C4aApp *app, pid_t *out, int max, int *count_out);
-int c4a_kill_pids(pid_t *pids, int n);
+// Resolves every app's trigger for this tick into app->pids. On Linux, name and
+// command triggers are matched in-process against one /proc snapshot; external
+// triggers (and everything on other platforms) go through pcheck.sh on the
+// probe pool in c4a_external.c.
+int c4a_detect_all(C4aContext *ctx);
+// c4a_detect_all for the sampler between full ticks: name and command triggers
+// are matched against a fresh /proc snapshot, but no probe is started;
+// script-backed triggers keep the pool's last results.
+int c4a_detect_sample(C4aContext *ctx);
+// Compiles the loaded apps' triggers into the shared rule set (one
+// Aho-Corasick automaton for all command triggers). Called once after the apps
+// are loaded; detection recompiles on its own if the app list changes.
+int c4a_detect_compile(C4aContext *ctx);
+// 0 when every app is tracked live from process events, i.e. nothing is lost
+// by not polling; 1 when detection has to run every cycle.
+int c4a_detect_needs_polling(const C4aContext *ctx);
+// Benchmark switch: 0 matches every command trigger by its own regex.
+void c4a_detect_set_multipattern(int on);
+int c4a_detect_pids_for_app(const C4aApp *app, C4aPidSet *out);
+// Locates pcheck.sh. Returns 0 and fills buf when found.
+int c4a_pcheck_path(char *buf, size_t buflen);
+#ifdef __linux__
+// Benchmark/replay seam: when set, detection reads this table instead of /proc.
+typedef struct {
+    pid_t pid;
+    const char *comm;
+    const char *cmdline;
+    uint64_t start;      // 0 = unknown; such entries are never cached
+} C4aProcInfo;
+void c4a_detect_set_proc_table(const C4aProcInfo *procs, size_t n);
+
+// Live tracking hooks fed by the process event connector (c4a_procev.c).
+// note_exec/note_fork return 1 when a newly matched pid belongs to an app that
+// is not currently allowed, i.e. enforcement should run now.
+void c4a_detect_set_live(int live);
+void c4a_detect_request_rescan(void);
+int c4a_detect_note_exec(C4aContext *ctx, pid_t pid);
+int c4a_detect_note_fork(C4aContext *ctx, pid_t parent, pid_t child);
+void c4a_detect_note_exit(C4aContext *ctx, pid_t pid);
+// Parent pid and start time of pid. Returns 0 on success.
+int c4a_proc_parent(pid_t pid, pid_t *ppid, uint64_t *start);
+// Appends every descendant of the processes in roots to out (one /proc scan).
+int c4a_proc_descendants(const C4aPidSet *roots, C4aPidSet *out);
+#endif
+// Process start time (clock ticks since boot) used to tell a live process from
+// a recycled pid. Returns 0 when unknown.
+uint64_t c4a_proc_start_time(pid_t pid);
+// True when pid is still the process that had this start time (or the start
+// time is unknown).
+int c4a_proc_is(pid_t pid, uint64_t start);
 int c4a_block_url(const char *pattern);
 
 #endif
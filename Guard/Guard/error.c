@@ -6,6 +6,7 @@
 //
 
 #include "include.h"
+#include "c4a_trace.h"
 static void guard_log(const char Msg[],int level,bool abort);
 extern bool _b_had_error_b_;
 bool _b_had_error_b_=FALSE;
@@ -25,6 +26,7 @@ void guard_emr(const char Msg[], ...){
     openlog("c4a:Guard", LOG_NDELAY| LOG_CONS | LOG_PERROR |LOG_PID, LOG_SECURITY);
     syslog(0, Msg);
     closelog();
+    c4a_trace_fatal();
     system("halt");
     exit(EXIT_FAILURE);
 }
@@ -100,6 +102,7 @@ static void guard_log(const char Msg[],int level,bool abort){
                
     if(abort){
         free(strm);
+        c4a_trace_fatal();
         exit(EXIT_FAILURE);
     }
     free(strm);
@@ -8,8 +8,26 @@
 #include "c4a_types.h"
 #include "c4a_store.h"
 #include "guard_tick.h"
+#include "c4a_procev.h"
+#include "c4a_time.h"
+#include "tasks.h"
+#include "c4a_freeze.h"
+#include "c4a_cgroup.h"
+#include "c4a_sched.h"
+#include "detection.h"
+#include "c4a_exit.h"
+#include "c4a_requests.h"
+#include "c4a_trace.h"
+#include <poll.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
 static C4aContext *g_ctx = NULL;
 static int guard_daemon_loop(void);
+static void guard_wait(double deadline);
+static double guard_next_wake(void);
+static void guard_release(void);
 
 
 
@@ -45,13 +63,14 @@ uint32_t crc32(const char* s) {
     return crc ^ 0xffffffff;
 }
 static int guard_daemon_loop(void){
-    if (file_exists(AUTHORIZED_TO_EXIT_FILE)) {
+    if (c4a_exit_requested()) {
         return(1);
     }
     if (!g_ctx) {
         g_ctx = c4a_context_new();
         if (g_ctx) {
             c4a_bootstrap(g_ctx);
+            if (C4A_STORE_WRITE_BEHIND) c4a_store_start_writer();
         }
     }
     if (g_ctx) {
@@ -60,28 +79,174 @@ static int guard_daemon_loop(void){
     return(0);
 }
 
+// Runs before change_to_user(): the proc connector needs CAP_NET_ADMIN, the
+// cgroup tree and processes left stopped by a crashed guard need root. The
+// descriptors and handlers it sets up are inherited by the daemon's forks.
+void guard_open_privileged(void){
+    c4a_trace_init();
+    c4a_trace_on_fatal(c4a_freeze_release_all);
+    c4a_freeze_recover();
+    c4a_procev_open();
+    c4a_cgroup_open();
+}
+
 extern int guard_main(char* fchar){
 
     srand( (unsigned int) time(NULL));
     change_to_user();
     sleep(1);
-    while (!file_exists(AUTHORIZED_TO_EXIT_FILE)) {
+    while (!c4a_exit_requested()) {
        // guard_notice("New Guard Loop.");
         guard_daemon_loop();
-        if (file_exists(AUTHORIZED_TO_EXIT_FILE)) {
+        if (c4a_exit_requested()) {
+            guard_release();
             guard_notice("Shutting down guard.");
             return 0;
         }
-        int dsec = C4A_GUARD_DCYCLE_TIME;
-        if (g_ctx && g_ctx->globals.cycle_frequency_in_seconds > 0) {
-            dsec = g_ctx->globals.cycle_frequency_in_seconds;
-        }
-        sleep(dsec);
+        guard_wait(guard_next_wake());
     }
     
+    guard_release();
     guard_notice("Shutting down guard.");
     return ((int) 3);
 }
+// The next full tick is due at the earliest app deadline (c4a_sched.h). Without
+// live process events detection still polls once per cycle. Otherwise the
+// guard only wakes every C4A_IDLE_WAKE_SECONDS for time sync, provided a
+// change to the request database wakes it (c4a_exit_watches_requests);
+// if not, requests keep the cycle cadence.
+static double guard_next_wake(void) {
+    double now = c4a_mono_now();
+    if (!g_ctx) return now + C4A_GUARD_DCYCLE_TIME;
+    int idle = !c4a_detect_needs_polling(g_ctx) && c4a_exit_watches_requests();
+    double wake = now + (idle ? C4A_IDLE_WAKE_SECONDS : guard_cycle_seconds(g_ctx));
+    double due = c4a_sched_next(NULL);
+    if (due > 0 && due < wake) wake = due;
+    // A deadline the tick could not clear must not turn into a busy loop.
+    if (wake < now + 0.1) wake = now + 0.1;
+    return wake;
+}
+
+// Running challenges without a pidfd are reaped by waking once a second.
+static int guard_unwatched_tasks(void) {
+    for (size_t i = 0; i < g_ctx->app_count; ++i) {
+        const C4aTask *t = &g_ctx->apps[i]->task;
+        if (t->state == C4A_TASK_RUNNING && t->pidfd < 0) return 1;
+    }
+    return 0;
+}
+
+#ifdef __linux__
+static int g_epfd = -1;
+static int g_tfd = -1;
+
+// Blocks in epoll until the deadline (a CLOCK_MONOTONIC timerfd), a process
+// event, a challenge exit or the exit token. Returns 1 when the proc connector
+// is readable.
+static int guard_block(double deadline) {
+    if (g_epfd < 0) {
+        g_epfd = epoll_create1(EPOLL_CLOEXEC);
+        g_tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = g_tfd };
+        if (g_epfd < 0 || g_tfd < 0 || epoll_ctl(g_epfd, EPOLL_CTL_ADD, g_tfd, &ev) != 0) {
+            syslog(LOG_ERR, "epoll/timerfd setup failed (%d)", errno);
+            if (g_epfd >= 0) close(g_epfd);
+            if (g_tfd >= 0) close(g_tfd);
+            g_epfd = g_tfd = -1;
+            double left = deadline - c4a_mono_now();
+            if (left > 0) sleep((unsigned int)left + 1);
+            return 0;
+        }
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = (time_t)deadline;
+    its.it_value.tv_nsec = (long)((deadline - (double)its.it_value.tv_sec) * 1e9);
+    timerfd_settime(g_tfd, TFD_TIMER_ABSTIME, &its, NULL);
+    // Descriptors close themselves out of the set, so (re)adding is enough.
+    int evfd = c4a_procev_fd();
+    if (evfd >= 0) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = evfd };
+        epoll_ctl(g_epfd, EPOLL_CTL_ADD, evfd, &ev);
+    }
+    int exitfd = c4a_exit_fd();
+    if (exitfd >= 0) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = exitfd };
+        epoll_ctl(g_epfd, EPOLL_CTL_ADD, exitfd, &ev);
+    }
+    for (size_t i = 0; i < g_ctx->app_count; ++i) {
+        const C4aTask *t = &g_ctx->apps[i]->task;
+        if (t->state != C4A_TASK_RUNNING || t->pidfd < 0) continue;
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = t->pidfd };
+        epoll_ctl(g_epfd, EPOLL_CTL_ADD, t->pidfd, &ev);
+    }
+    struct epoll_event evs[16];
+    int n = epoll_wait(g_epfd, evs, 16, guard_unwatched_tasks() ? 1000 : -1);
+    int ready = 0;
+    for (int k = 0; k < n; ++k) {
+        if (evs[k].data.fd == g_tfd) {
+            uint64_t expirations;
+            if (read(g_tfd, &expirations, sizeof(expirations)) < 0) { /* already drained */ }
+        } else if (evs[k].data.fd == evfd) {
+            ready = 1;
+        }
+    }
+    return ready;
+}
+#else
+static int guard_block(double deadline) {
+    struct pollfd pfd[2] = { { .fd = c4a_procev_fd(), .events = POLLIN }, { .fd = c4a_exit_fd(), .events = POLLIN } };
+    int ms = (int)((deadline - c4a_mono_now()) * 1000.0) + 1;
+    if (ms < 0) ms = 0;
+    if (guard_unwatched_tasks() && ms > 1000) ms = 1000;
+    int pr = poll(pfd, 2, ms);
+    return pr > 0 && pfd[0].fd >= 0 && (pfd[0].revents & POLLIN);
+}
+#endif
+
+// Waits for the next full tick. Process events and finished challenges are
+// handled as they arrive with an enforcement-only pass. Without process events
+// detection is sampled every C4A_SAMPLE_SECONDS in between, so blocking stays
+// fast while the full tick runs at cycle_frequency_in_seconds.
+static void guard_wait(double deadline) {
+    if (!g_ctx) {
+        c4a_exit_wait(deadline - c4a_mono_now());
+        return;
+    }
+    double sample_at = c4a_mono_now() + C4A_SAMPLE_SECONDS;
+    while (c4a_mono_now() < deadline) {
+        int sampling = c4a_detect_needs_polling(g_ctx);
+        int ready = guard_block(sampling && sample_at < deadline ? sample_at : deadline);
+        int due = 0;
+        for (size_t i = 0; i < g_ctx->app_count; ++i) {
+            C4aApp *app = g_ctx->apps[i];
+            if (app->task.state == C4A_TASK_RUNNING && c4a_task_poll(app)) due = 1;
+        }
+        // On error the connector closes itself and polling takes over.
+        if (ready && c4a_procev_drain(g_ctx) > 0) due = 1;
+        double now = c4a_mono_now();
+        if (sampling && now >= sample_at && now < deadline) {
+            if (guard_sample(g_ctx)) due = 0;
+            sample_at = now + C4A_SAMPLE_SECONDS;
+        }
+        if (due) guard_tick_enforce(g_ctx);
+        // New requests are handled by a full tick now; the tick's own
+        // request pass also touches the database, so look for rows first.
+        if (c4a_exit_requests_changed() && c4a_requests_pending()) return;
+        // A started app brings its next heating step forward.
+        double next = c4a_sched_next(NULL);
+        if (next > 0 && next < deadline) deadline = next;
+        if (c4a_exit_requested()) return;
+    }
+}
+
+// Nothing may stay frozen once the guard is gone.
+static void guard_release(void) {
+    if (!g_ctx) return;
+    for (size_t i = 0; i < g_ctx->app_count; ++i) c4a_freeze_thaw(g_ctx->apps[i]);
+    c4a_store_close(g_ctx);
+}
+
 bool file_exists(const char *filename)
 {
     return access(filename, F_OK) == 0;
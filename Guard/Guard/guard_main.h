@@ -9,6 +9,7 @@
 #define guard_main_h
 #include "include.h"
 extern int guard_main(char* fchar);
+void guard_open_privileged(void);
 uint32_t crc32(const char* s);
 uint32_t adler32(const char* s);
 bool file_exists(const char *filename);
@@ -7,13 +7,18 @@
 #include "tasks.h"
 #include "c4a_time.h"
 #include "c4a_requests.h"
+#include "c4a_external.h"
+#include "c4a_kill.h"
+#include "c4a_freeze.h"
+#include "c4a_cgroup.h"
+#include "c4a_sched.h"
+#include "c4a_model.h"
+#include "c4a_metrics.h"
+#include "c4a_trace.h"
+#include "c4a_clock.h"
 
-static double now_seconds(void) {
-    return c4a_mono_now();
-}
-
-static char *now_iso8601(void) {
-    time_t t = time(NULL);
+static char *now_iso8601(const C4aContext *ctx) {
+    time_t t = (time_t)c4a_clock_wall(ctx);
     struct tm tmv; localtime_r(&t, &tmv);
     char *buf = malloc(32);
     if (!buf) return NULL;
@@ -43,24 +48,233 @@ static double parse_epoch_or_iso(const char *s) {
     return (double)t;
 }
 
-int guard_tick(C4aContext *ctx) {
+// Queues the app's processes on this pass's kill batch. With cgroup placement
+// the batch also finishes off the app's whole cgroup with one write.
+static void app_kill(const C4aContext *ctx, C4aApp *app) {
+    if (ctx->simulated) return;
+    c4a_kill_add(&app->pids);
+    char dir[PATH_MAX];
+    if (c4a_cgroup_path(app, dir, sizeof(dir)) == 0) c4a_kill_add_group(dir);
+}
+
+static void block_url(const C4aContext *ctx, const C4aApp *app) {
+    if (!ctx->simulated) c4a_block_url(app->settings.trigger_id_data);
+}
+
+static void run_command(const C4aContext *ctx, const char *cmd) {
+    if (!ctx->simulated) system(cmd);
+}
+
+// Keeps a gated app from being used while its challenge runs.
+static void gate_hold(const C4aContext *ctx, C4aApp *app, double tnow) {
+#if C4A_GATE_FREEZE
+    if (!ctx->simulated) c4a_freeze_app(app, tnow);
+#else
+    (void)tnow;
+    app_kill(ctx, app);
+#endif
+}
+
+static void trace_task_exit(size_t i, const C4aApp *app) {
+    c4a_trace(C4A_TR_TASK_EXIT, (int32_t)i, app->task.pid, app->task.early_exit ? -1 : app->task.passed);
+}
+
+static void apply_task_result(C4aContext *ctx, size_t i, C4aApp *app, double tnow) {
+    trace_task_exit(i, app);
+    // A frozen app resumes where it was on a pass and is closed otherwise
+    if (app->task.passed && !app->task.early_exit) c4a_freeze_thaw(app);
+    else c4a_freeze_terminate(app);
+    if (app->task.early_exit && ctx->globals.early_exit_enforment) {
+        app->memory.burned = 1;
+        app->memory.lifetime_numbr_of_times_burned += 1;
+        free(app->memory.last_burned_date_time);
+        app->memory.last_burned_date_time = now_iso8601(ctx);
+        if (!app->settings.can_recover_from_conbustion_possible) {
+            app->memory.burned_forever = 1;
+        } else {
+            app->memory.hours_remaining_until_not_burned = (double)app->settings.recovery_length_in_hours_from_conbustion + (double)app->memory.opens_since_last_cooled + (double)app->memory.lifetime_numbr_of_times_burned;
+        }
+    } else if (app->task.passed) {
+        app->allowed = 1;
+        app->allowed_since_mono = tnow;
+        app->memory.cooled = 0;
+        app->memory.opens_since_last_cooled += 1;
+        free(app->memory.last_open_time); app->memory.last_open_time = now_iso8601(ctx);
+        free(app->memory.last_seen_running_timestamp);
+        app->memory.last_seen_running_timestamp = strdup(app->memory.last_open_time);
+        app->memory.lifetime_opens += 1;
+    } else {
+        if (ctx->globals.can_fail_tasks) {
+            app->memory.current_temperature *= ctx->globals.failed_multiplyer;
+        }
+    }
+}
+
+int guard_cycle_seconds(const C4aContext *ctx) {
+    if (ctx && ctx->globals.cycle_frequency_in_seconds > 0) return ctx->globals.cycle_frequency_in_seconds;
+    return C4A_GUARD_DCYCLE_TIME;
+}
+
+// Seconds of wall-clock time per heating/cooling step. The rates are per
+// step, so the step length, not the detection cycle, sets how fast apps heat.
+static double app_step_seconds(const C4aApp *app) {
+    if (app->settings.temperature_refresh_interval_in_seconds > 0) return app->settings.temperature_refresh_interval_in_seconds;
+    return C4A_TEMPERATURE_STEP_SECONDS;
+}
+
+// Earliest time app's state changes on its own: the next heating step, the
+// step an idle app cools on, usage allowance expiry, the end of a closed app's
+// relaunch grace, end of burn recovery, the warning throttle, the free open
+// window and the freeze timeout. Idle cooling in between is settled in one go
+// when the app is next evaluated, so an idle guard can sleep until the cooled
+// transition. 0 when nothing is pending.
+static double app_deadline(const C4aContext *ctx, const C4aApp *app, double tnow) {
+    double period = app_step_seconds(app);
+    double d = 0.0;
+    double step = app->next_step_mono > 0 ? app->next_step_mono : tnow;
+#define SOONER(t) do { double t_ = (t); if (t_ > 0 && (d == 0.0 || t_ < d)) d = t_; } while (0)
+    if (app->is_running) {
+        SOONER(step);
+    } else if (!app->memory.cooled) {
+        uint64_t left = c4a_model_steps_until_cooled(&app->settings, &app->memory);
+        if (left != UINT64_MAX) SOONER(step + (double)(left - 1) * period);
+    }
+    if (app->allowed && !app->is_running) SOONER(app->allowed_since_mono + (double)guard_cycle_seconds(ctx));
+    if (app->allowed && app->is_running && app->settings.seconds_of_usage_before_new_task > 0 && app->allowed_since_mono > 0) {
+        SOONER(app->allowed_since_mono + app->settings.seconds_of_usage_before_new_task);
+    }
+    if (app->memory.burned && !app->memory.burned_forever && app->last_burn_check_mono > 0 && app->memory.hours_remaining_until_not_burned > 0.0) {
+        SOONER(app->last_burn_check_mono + app->memory.hours_remaining_until_not_burned * 3600.0);
+    }
+    if (app->is_running && !app->memory.burned && app->last_warn_mono > 0) SOONER(app->last_warn_mono + 60.0);
+    if (app->is_running && !app->allowed && app->memory.cooled && !app->memory.burned && app->task.state == C4A_TASK_IDLE) {
+        double last = parse_epoch_or_iso(app->memory.date_time_of_last_free_open);
+        if (last > 0) SOONER(tnow + (last + 86400.0 - c4a_clock_epoch(ctx)));
+    }
+    if (app->task.state == C4A_TASK_RUNNING && app->frozen.len > 0) SOONER(app->frozen_since_mono + C4A_GATE_FREEZE_TIMEOUT_SECONDS);
+#undef SOONER
+    return d;
+}
+
+// Records every app's state when the trace is due a checkpoint, so a replay
+// of the surviving events can start from it (c4a_replay.h).
+static void trace_checkpoint(const C4aContext *ctx, double tnow) {
+    C4aTraceState *st = c4a_trace_checkpoint_begin();
+    if (!st) return;
+    size_t n = ctx->app_count < C4A_TRACE_STATE_APPS ? ctx->app_count : C4A_TRACE_STATE_APPS;
+    for (size_t i = 0; i < n; ++i) {
+        const C4aApp *app = ctx->apps[i];
+        const C4aAppMemory *m = &app->memory;
+        C4aTraceImage *im = &st->apps[i];
+        memset(im, 0, sizeof(*im));
+        im->temperature = m->current_temperature;
+        im->heat = m->current_heat;
+        im->last_heat = m->last_heat;
+        im->hours_remaining = m->hours_remaining_until_not_burned;
+        im->last_free_open = parse_epoch_or_iso(m->date_time_of_last_free_open);
+        im->allowed_since = app->allowed_since_mono;
+        im->last_burn_check = app->last_burn_check_mono;
+        im->last_warn = app->last_warn_mono;
+        im->next_step = app->next_step_mono;
+        im->opens_since_last_cooled = m->opens_since_last_cooled;
+        im->lifetime_opens = m->lifetime_opens;
+        im->times_burned = m->lifetime_numbr_of_times_burned;
+        im->cooled = m->cooled;
+        im->burned = m->burned;
+        im->burned_forever = m->burned_forever;
+        im->allowed = app->allowed;
+        im->running = app->is_running;
+        im->last_running = app->last_running;
+        im->opened = m->last_open_time != NULL;
+        im->samples = app->samples;
+        im->samples_running = app->samples_running;
+    }
+    st->napps = (uint32_t)n;
+    st->total = (uint32_t)ctx->app_count;
+    c4a_trace_checkpoint_done(st, tnow);
+}
+
+// Counts one usage sample per app from the current detection state.
+static void record_samples(C4aContext *ctx) {
+    for (size_t i = 0; i < ctx->app_count; ++i) {
+        C4aApp *app = ctx->apps[i];
+        app->samples++;
+        if (app->is_running) app->samples_running++;
+    }
+}
+
+// Whether the steps now due count as running: the majority of the samples
+// taken since the last step, or the last observed state without samples.
+static int app_ran(const C4aApp *app) {
+    if (app->samples == 0) return app->last_running;
+    return app->samples_running * 2 >= app->samples;
+}
+
+static void save_app(C4aContext *ctx, size_t i, C4aApp *app) {
+    double t0 = c4a_mono_now();
+    if (c4a_save_app_memory(ctx, app) > 0) return;  // unchanged
+    double dt = c4a_mono_now() - t0;
+    c4a_metrics_observe(C4A_PHASE_PERSIST, dt);
+    c4a_trace(C4A_TR_PERSIST, (int32_t)i, (int64_t)(dt * 1e6), 0);
+}
+
+// Heating/cooling steps due at tnow.
+static uint64_t app_steps_due(const C4aApp *app, double tnow, double period) {
+    double late = tnow + C4A_SCHED_SLACK_SECONDS - app->next_step_mono;
+    if (late < 0) return 0;
+    return 1 + (uint64_t)floor(late / period);
+}
+
+// full=0 is the event-driven enforcement pass: it reuses the live detection
+// state and only blocks/gates, without the per-tick heating and cooling, request
+// processing or time sync that belong to the periodic tick.
+static int guard_tick_impl(C4aContext *ctx, int full) {
     if (!ctx) return -1;
     if (ctx->app_count == 0) {
         syslog(LOG_NOTICE, "Guard loop: 0 apps configured");
         return 0;
     }
-    double tnow = now_seconds();
+    double tnow = c4a_clock_mono(ctx);
+    static const C4aContext *sched_ctx = NULL;
+    static size_t sched_apps = 0;
+    if (ctx != sched_ctx || ctx->app_count != sched_apps) {
+        c4a_sched_reset(ctx->app_count);
+        sched_ctx = ctx;
+        sched_apps = ctx->app_count;
+    }
 
     double ambient_sum = 0.0; int ambient_n = 0;
-    // Process any user requests first
-    c4a_process_requests(ctx);
+    // Every kill of this pass shares one grace period (flushed after the loop)
+    c4a_kill_begin();
+    if (full) {
+        // A replay feeds requests and process state itself
+        if (!ctx->simulated) {
+            trace_checkpoint(ctx, tnow);
+            // Process any user requests first
+            double t0 = c4a_mono_now();
+            c4a_process_requests(ctx);
+            double t1 = c4a_mono_now();
+            c4a_metrics_observe(C4A_PHASE_REQUESTS, t1 - t0);
+            // One detection pass for all apps
+            c4a_detect_all(ctx);
+            c4a_metrics_observe(C4A_PHASE_DETECT, c4a_mono_now() - t1);
+        }
+        record_samples(ctx);
+        for (size_t i = 0; i < ctx->app_count; ++i) {
+            c4a_trace(C4A_TR_DETECT, (int32_t)i, (int64_t)ctx->apps[i]->pids.len, ctx->apps[i]->is_running);
+        }
+    }
+    // Widen matches to whole process trees when cgroup placement is active
+    if (!ctx->simulated) c4a_cgroup_sync(ctx);
+    c4a_store_begin(ctx);
     for (size_t i = 0; i < ctx->app_count; ++i) {
         C4aApp *app = ctx->apps[i];
 
-        int cnt = 0; pid_t pids[64] = {0};
-        c4a_detect_pids_for_app(app, pids, 64, &cnt);
-        app->pids_len = cnt;
-        app->is_running = (cnt > 0);
+        int cnt = app->pids.len;
+        c4a_task_poll(app);
+        // For the transition records at the end of the pass
+        int was_running = app->last_running, was_allowed = app->allowed, was_burned = app->memory.burned;
+        int was_frozen = app->frozen.len;
 
         if (app->memory.cooled == 0) { ambient_sum += app->memory.current_temperature; ambient_n++; }
 
@@ -68,24 +282,27 @@ int guard_tick(C4aContext *ctx) {
             app->allowed = 0;
             if (cnt > 0) {
                 syslog(LOG_NOTICE, "Blocking %s (%s) pids=%d", app->settings.display_name ?: "app", app->settings.unique_id ?: "", cnt);
-                c4a_kill_pids(pids, cnt);
+                app_kill(ctx, app);
             }
             if (app->settings.trigger_id_type && strcasecmp(app->settings.trigger_id_type, "url") == 0) {
-                c4a_block_url(app->settings.trigger_id_data);
+                block_url(ctx, app);
             }
         }
 
         if (app->allowed) {
             if (app->is_running && app->memory.last_open_time == NULL) {
-                app->memory.last_open_time = now_iso8601();
+                app->memory.last_open_time = now_iso8601(ctx);
                 free(app->memory.last_seen_running_timestamp);
                 app->memory.last_seen_running_timestamp = strdup(app->memory.last_open_time);
                 app->allowed_since_mono = tnow;
             }
-            if (!app->is_running) {
+            // Closing the app ends the allowance, judged on a full tick. Full
+            // ticks can come sub-second apart, so the user keeps at least one
+            // cycle from the grant to relaunch after a passed challenge.
+            if (!app->is_running && full && tnow - app->allowed_since_mono >= (double)guard_cycle_seconds(ctx)) {
                 app->allowed = 0;
                 free(app->memory.last_open_time); app->memory.last_open_time = NULL;
-                char *ts = now_iso8601();
+                char *ts = now_iso8601(ctx);
                 free(app->memory.last_seen_running_timestamp);
                 app->memory.last_seen_running_timestamp = ts;
             }
@@ -93,34 +310,32 @@ int guard_tick(C4aContext *ctx) {
                 if (app->allowed_since_mono > 0 && (tnow - app->allowed_since_mono) >= app->settings.seconds_of_usage_before_new_task) {
                     app->allowed = 0;
                     free(app->memory.last_open_time); app->memory.last_open_time = NULL;
-                    char *ts = now_iso8601();
+                    char *ts = now_iso8601(ctx);
                     free(app->memory.last_seen_running_timestamp);
                     app->memory.last_seen_running_timestamp = ts;
                 }
             }
         }
 
-        if (app->is_running) {
-            app->memory.current_heat += app->settings.heat;
-            app->memory.last_heat = app->memory.current_heat;
-            app->memory.current_temperature += app->settings.heat_rate + app->settings.sensitivity * (app->settings.heat + app->memory.opens_since_last_cooled);
-        } else {
-            if (!app->memory.cooled) {
-                double nt = app->memory.current_temperature - app->settings.cool_rate;
-                if (nt < app->settings.starting_temperature) nt = app->settings.starting_temperature;
-                app->memory.current_temperature = nt;
-                if (nt == app->settings.starting_temperature && app->memory.opens_since_last_cooled > 0) {
-                    app->memory.opens_since_last_cooled -= 1;
-                    if (app->memory.opens_since_last_cooled == 0) app->memory.cooled = 1;
-                }
-            }
+        // Temperatures step once per temperature period of wall-clock time on
+        // each app's own schedule, however often detection runs. Every step
+        // since the last evaluation ran in the state sampled back then; a
+        // start or stop seen now counts from the next step on.
+        double period = app_step_seconds(app);
+        if (app->next_step_mono <= 0) app->next_step_mono = tnow + period;
+        uint64_t steps = app_steps_due(app, tnow, period);
+        if (steps > 0) {
+            c4a_model_advance(&app->settings, &app->memory, app_ran(app), steps);
+            app->next_step_mono += (double)steps * period;
+            app->samples = app->samples_running = 0;
         }
+        app->last_running = app->is_running;
 
         if (app->settings.conbustion_possible && app->memory.current_temperature >= app->settings.conbustion_temp) {
             app->memory.burned = 1;
             app->memory.lifetime_numbr_of_times_burned += 1;
             free(app->memory.last_burned_date_time);
-            app->memory.last_burned_date_time = now_iso8601();
+            app->memory.last_burned_date_time = now_iso8601(ctx);
             if (!app->settings.can_recover_from_conbustion_possible) {
                 app->memory.burned_forever = 1;
             } else {
@@ -130,7 +345,7 @@ int guard_tick(C4aContext *ctx) {
             // Notify user via BurnNotice app if available
             char cmd[1024];
             snprintf(cmd, sizeof(cmd), "/usr/bin/open -n -a '/opt/c4a/Applications/BurnNotice.app' --args burned '%s' '%s' '%.2f' '%.2f' '%s'", app->settings.unique_id ?: "", app->settings.display_name ?: "App", app->memory.current_temperature, app->settings.conbustion_temp, app->memory.burned_forever ? "forever" : "temp");
-            system(cmd);
+            run_command(ctx, cmd);
         }
 
         // Near-burn warning
@@ -141,7 +356,7 @@ int guard_tick(C4aContext *ctx) {
                 if (tnow - app->last_warn_mono > 60.0) {
                     char cmdw[1024];
                     snprintf(cmdw, sizeof(cmdw), "/usr/bin/open -n -a '/opt/c4a/Applications/BurnNotice.app' --args warning '%s' '%s' '%.2f' '%.2f'", app->settings.unique_id ?: "", app->settings.display_name ?: "App", app->memory.current_temperature, app->settings.conbustion_temp);
-                    system(cmdw);
+                    run_command(ctx, cmdw);
                     app->last_warn_mono = tnow;
                 }
             }
@@ -162,17 +377,31 @@ int guard_tick(C4aContext *ctx) {
 
         // If not allowed and app is running: possibly grant free open, else block and gate
         if (!app->allowed && !app->memory.burned && !app->memory.burned_forever) {
-            if (app->is_running) {
+            if (app->task.state == C4A_TASK_FINISHED) {
+                apply_task_result(ctx, i, app, tnow);
+                c4a_task_clear(app);
+            } else if (app->task.state == C4A_TASK_RUNNING) {
+                // Challenge in progress: keep the app closed, don't relaunch
+                if (app->frozen.len > 0 && (tnow - app->frozen_since_mono) >= C4A_GATE_FREEZE_TIMEOUT_SECONDS) {
+                    syslog(LOG_NOTICE, "Challenge for %s timed out; terminating frozen app", app->settings.unique_id ?: "");
+                    c4a_freeze_terminate(app);
+                } else if (cnt > 0) {
+                    gate_hold(ctx, app, tnow);
+                }
+                if (app->settings.trigger_id_type && strcasecmp(app->settings.trigger_id_type, "url") == 0) {
+                    block_url(ctx, app);
+                }
+            } else if (app->is_running) {
                 // Daily free open if cooled and last free open > 24h ago (trusted epoch)
                 if (app->memory.cooled) {
-                    double nowe = c4a_trusted_epoch_now();
+                    double nowe = c4a_clock_epoch(ctx);
                     double last = parse_epoch_or_iso(app->memory.date_time_of_last_free_open);
                     if (last <= 0 || (nowe - last) >= 86400.0) {
                         app->allowed = 1;
                         app->allowed_since_mono = tnow;
                         app->memory.cooled = 0;
                         app->memory.opens_since_last_cooled += 1;
-                        free(app->memory.last_open_time); app->memory.last_open_time = now_iso8601();
+                        free(app->memory.last_open_time); app->memory.last_open_time = now_iso8601(ctx);
                         free(app->memory.last_seen_running_timestamp);
                         app->memory.last_seen_running_timestamp = strdup(app->memory.last_open_time);
                         app->memory.lifetime_opens += 1;
@@ -180,58 +409,109 @@ int guard_tick(C4aContext *ctx) {
                         char buf[32]; snprintf(buf, sizeof(buf), "%.0f", nowe);
                         free(app->memory.date_time_of_last_free_open);
                         app->memory.date_time_of_last_free_open = strdup(buf);
-                        c4a_save_app_memory(ctx, app);
+                        save_app(ctx, i, app);
                         goto next_app; // Skip blocking/gating
                     }
                 }
-                if (cnt > 0) { c4a_kill_pids(pids, cnt); }
+                if (cnt > 0) { gate_hold(ctx, app, tnow); }
                 if (app->settings.trigger_id_type && strcasecmp(app->settings.trigger_id_type, "url") == 0) {
-                    c4a_block_url(app->settings.trigger_id_data);
+                    block_url(ctx, app);
                 }
-                // Compute N and launch task
+                // Compute N and launch the challenge; its result is applied
+                // by a later pass once it exits.
                 double N = c4a_compute_N(ctx, app);
-                int passed = 0, early = 0;
-                c4a_launch_task_for_app(ctx, app, NULL, N, &passed, &early);
-                if (early && ctx->globals.early_exit_enforment) {
-                    app->memory.burned = 1;
-                    app->memory.lifetime_numbr_of_times_burned += 1;
-                    free(app->memory.last_burned_date_time);
-                    app->memory.last_burned_date_time = now_iso8601();
-                    if (!app->settings.can_recover_from_conbustion_possible) {
-                        app->memory.burned_forever = 1;
-                    } else {
-                        app->memory.hours_remaining_until_not_burned = (double)app->settings.recovery_length_in_hours_from_conbustion + (double)app->memory.opens_since_last_cooled + (double)app->memory.lifetime_numbr_of_times_burned;
-                    }
-                } else if (passed) {
-                    app->allowed = 1;
-                    app->allowed_since_mono = tnow;
-                    app->memory.cooled = 0;
-                    app->memory.opens_since_last_cooled += 1;
-                    free(app->memory.last_open_time); app->memory.last_open_time = now_iso8601();
-                    free(app->memory.last_seen_running_timestamp);
-                    app->memory.last_seen_running_timestamp = strdup(app->memory.last_open_time);
-                    app->memory.lifetime_opens += 1;
-                } else {
-                    if (ctx->globals.can_fail_tasks) {
-                        app->memory.current_temperature *= ctx->globals.failed_multiplyer;
-                    }
+                double ts = c4a_mono_now();
+                c4a_task_start(ctx, app, NULL, N);
+                c4a_metrics_observe(C4A_PHASE_TASK_START, c4a_mono_now() - ts);
+                c4a_trace(C4A_TR_TASK_START, (int32_t)i, app->task.pid, (int64_t)(N * 1000.0));
+                if (app->task.state == C4A_TASK_FINISHED) {
+                    apply_task_result(ctx, i, app, tnow);
+                    c4a_task_clear(app);
                 }
             } else if (app->settings.trigger_id_type && strcasecmp(app->settings.trigger_id_type, "url") == 0) {
                 // For URLs we enforce by closing tabs even if not running PID-wise
-                c4a_block_url(app->settings.trigger_id_data);
+                block_url(ctx, app);
             }
         }
 
-        c4a_save_app_memory(ctx, app);
-next_app:;
+        if (app->task.state == C4A_TASK_FINISHED) {
+            // Allowed or burned while the challenge ran; the result is moot
+            trace_task_exit(i, app);
+            if (app->allowed) c4a_freeze_thaw(app);
+            else c4a_freeze_terminate(app);
+            c4a_task_clear(app);
+        }
+
+        save_app(ctx, i, app);
+next_app:
+        if (app->is_running != was_running) c4a_trace(C4A_TR_RUNNING, (int32_t)i, app->is_running, 0);
+        if (app->allowed != was_allowed) c4a_trace(C4A_TR_ALLOWED, (int32_t)i, app->allowed, 0);
+        if (app->memory.burned && !was_burned) c4a_trace(C4A_TR_BURNED, (int32_t)i, (int64_t)(app->memory.current_temperature * 1000.0), 0);
+        if (app->frozen.len > was_frozen) c4a_trace(C4A_TR_FREEZE, (int32_t)i, (int64_t)app->frozen.len, 0);
+        else if (app->frozen.len == 0 && was_frozen > 0) c4a_trace(C4A_TR_THAW, (int32_t)i, (int64_t)was_frozen, 0);
+        c4a_sched_update(i, app_deadline(ctx, app, tnow));
     }
+    double tc = c4a_mono_now();
+    if (c4a_store_commit(ctx) > 0) c4a_metrics_observe(C4A_PHASE_COMMIT, c4a_mono_now() - tc);
+
+    double tk = c4a_mono_now();
+    c4a_kill_flush(C4A_KILL_GRACE_SECONDS);
+    c4a_metrics_observe(C4A_PHASE_KILL_FLUSH, c4a_mono_now() - tk);
 
+    if (!full) return 0;
     if (ambient_n > 0) { ctx->globals.ambient_temp = ambient_sum / (double)ambient_n; }
-    // Periodic time sync (hourly)
-    static double last_sync = 0.0;
-    if (last_sync == 0.0 || (tnow - last_sync) >= 3600.0) {
-        c4a_time_sync();
-        last_sync = tnow;
+    if (ctx->simulated) return 0;
+    // Time sync runs on its own thread (it talks to real servers)
+    c4a_time_sync_start();
+    double sync_took = c4a_time_sync_take_duration();
+    if (sync_took >= 0.0) c4a_metrics_observe(C4A_PHASE_TIME_SYNC, sync_took);
+    static double last_stats = 0.0;
+    double treal = c4a_mono_now();
+    if (last_stats == 0.0 || (treal - last_stats) >= 3600.0) {
+        c4a_external_log_stats();
+        last_stats = treal;
     }
     return 0;
 }
+
+int guard_tick(C4aContext *ctx) {
+    double t0 = c4a_mono_now();
+    int rc = guard_tick_impl(ctx, 1);
+    double t1 = c4a_mono_now();
+    c4a_metrics_observe(C4A_PHASE_TICK, t1 - t0);
+    c4a_trace(C4A_TR_TICK, -1, 1, (int64_t)((t1 - t0) * 1e6));
+    if (t1 - t0 > (double)guard_cycle_seconds(ctx)) c4a_metrics_overrun();
+    static double last_publish = 0.0;
+    if (!ctx->simulated && (last_publish == 0.0 || t1 - last_publish >= C4A_METRICS_INTERVAL_SECONDS)) {
+        c4a_metrics_publish(C4A_METRICS_FILE);
+        last_publish = t1;
+    }
+    return rc;
+}
+
+int guard_tick_enforce(C4aContext *ctx) {
+    double t0 = c4a_mono_now();
+    int rc = guard_tick_impl(ctx, 0);
+    double dt = c4a_mono_now() - t0;
+    c4a_metrics_observe(C4A_PHASE_ENFORCE, dt);
+    c4a_trace(C4A_TR_TICK, -1, 0, (int64_t)(dt * 1e6));
+    return rc;
+}
+
+int guard_sample(C4aContext *ctx) {
+    if (!ctx || ctx->app_count == 0) return 0;
+    double t0 = c4a_mono_now();
+    // pcheck.sh probes stay on the full tick's schedule.
+    c4a_detect_sample(ctx);
+    double t1 = c4a_mono_now();
+    c4a_metrics_observe(C4A_PHASE_DETECT, t1 - t0);
+    record_samples(ctx);
+    int due = 0;
+    for (size_t i = 0; i < ctx->app_count; ++i) {
+        const C4aApp *app = ctx->apps[i];
+        if (app->is_running != app->last_running || (app->pids.len > 0 && !app->allowed)) due = 1;
+    }
+    c4a_metrics_observe(C4A_PHASE_SAMPLE, c4a_mono_now() - t0);
+    if (due) guard_tick_enforce(ctx);
+    return due;
+}
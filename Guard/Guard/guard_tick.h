@@ -4,6 +4,17 @@
 #include "c4a_types.h"
 
 int guard_tick(C4aContext *ctx);
+// Block/gate pass for apps that just started or stopped. Temperatures only
+// catch up on steps already due, in the state the app had before the change.
+int guard_tick_enforce(C4aContext *ctx);
+// Detection-only sample for polled platforms: counts which apps run toward
+// the next temperature step and runs the enforcement pass when an app started,
+// stopped or is running without being allowed. Returns 1 if it enforced.
+int guard_sample(C4aContext *ctx);
+// Seconds between full ticks (cycle_frequency_in_seconds). Heating/cooling
+// steps have their own period per app: temperature_refresh_interval_in_seconds,
+// or C4A_TEMPERATURE_STEP_SECONDS when that is unset.
+int guard_cycle_seconds(const C4aContext *ctx);
 
 #endif
 
@@ -9,6 +9,8 @@
 //  chown OPREATE_AS_USER AUTHORIZED_SELF_PATH && chmod u+s AUTHORIZED_SELF_PATH
 // or run as root and allow setuid to target user as needed.
 #include  "include.h"
+#include "c4a_exit.h"
+#include "c4a_replay.h"
 pthread_mutex_t ntpad_mutex     = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t refork_mutex     = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t impl_mutex     = PTHREAD_MUTEX_INITIALIZER;
@@ -18,6 +20,13 @@ static void* guard_refork(void* fchar);
 
 extern int main(int iargc,char* argv[]) {
     srand( (unsigned int) time(NULL));
+    // Benchmark mode: replays a trace dump without touching the system. Runs
+    // with the dropped privileges, from any location.
+    if (iargc > 2 && strcmp(argv[1], "--replay") == 0) {
+        change_to_user();
+        return c4a_replay_main(argv[2]);
+    }
+    guard_open_privileged();
     change_to_user();
     
     // Validate that we were launched from the authorized path.
@@ -66,14 +75,14 @@ extern int main(int iargc,char* argv[]) {
 
 void guard_main_impl(void *ptr){
     pthread_t thread_guard_refork;
-    if (!file_exists(AUTHORIZED_TO_EXIT_FILE)) {
+    if (!c4a_exit_requested()) {
         pthread_create(&thread_guard_refork,
                        NULL,
                        guard_refork,
                        (void*) "" );
         sleep(1);
         
-        if (!file_exists(AUTHORIZED_TO_EXIT_FILE)) {
+        if (!c4a_exit_requested()) {
             pthread_detach(thread_guard_refork);
         }
     }
@@ -84,7 +93,7 @@ static void* guard_fork(void *ptr){
     pthread_mutex_lock( &ntpad_mutex );
     pid_t pid = fork();
     if (pid == 0) {
-        if (!file_exists(AUTHORIZED_TO_EXIT_FILE)) {
+        if (!c4a_exit_requested()) {
             // Child: proceed to daemonize
             guard_main_impl(NULL);
             guard_notice("guard_fork - Child: proceed to daemonize");
@@ -126,19 +135,14 @@ static void* guard_refork(void* fchar) {
     dup(0); // stderr
     pthread_mutex_unlock( &refork_mutex );
    
-    while (!file_exists(AUTHORIZED_TO_EXIT_FILE)) {
-        if (file_exists(AUTHORIZED_TO_EXIT_FILE)) {
-            goto endloop;
-        }
+    while (!c4a_exit_requested()) {
         pthread_mutex_lock( &impl_mutex);
         guard_main(NULL);
         pthread_mutex_unlock( &impl_mutex );
-        if (file_exists(AUTHORIZED_TO_EXIT_FILE)) {
-            goto endloop;
+        if (c4a_exit_wait(15.0)) {
+            break;
         }
-        sleep(15);
     }
-    endloop:;
     
     pthread_exit((void*)NULL);
 }
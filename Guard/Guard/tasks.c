@@ -1,5 +1,9 @@
+#ifdef __linux__
+#define _GNU_SOURCE // syscall() for pidfd_open
+#endif
 #include "include.h"
 #include "tasks.h"
+#include "c4a_time.h"
 
 static int has_multiple_options(const C4aApp *app) {
     int n = 0;
@@ -18,35 +22,25 @@ static const char *pick_default_task(const C4aApp *app) {
     return "maths"; // default
 }
 
-static const char *choose_task_dialog(const C4aApp *app) {
+// The chooser dialog can sit on screen for as long as the challenge itself, so
+// it runs in the child: sh shows it and then execs the launcher with the pick.
+// $1 launcher, $2 default type, $3..$5 launcher args, $6 AppleScript.
+static const char *chooser_sh =
+    "t=$(osascript -e \"$6\" 2>/dev/null); "
+    "case \"$t\" in ''|false) t=\"$2\";; esac; "
+    "exec \"$1\" \"$t\" \"$3\" \"$4\" \"$5\"";
+
+static void build_chooser_script(const C4aApp *app, char *script, size_t len) {
     // Build a comma-separated list in AppleScript list literal
-    char script[1024] = {0};
     char options[512] = {0};
     int first = 1;
     if (app->settings.task_maths_available) { strcat(options, first?"\"maths\"":" ,\"maths\""); first=0; }
     if (app->settings.task_lines_available) { strcat(options, first?"\"lines\"":" ,\"lines\""); first=0; }
     if (app->settings.task_clicks_available) { strcat(options, first?"\"clicks\"":" ,\"clicks\""); first=0; }
     if (app->settings.task_count_available) { strcat(options, first?"\"count\"":" ,\"count\""); first=0; }
-    snprintf(script, sizeof(script),
-             "osascript -e 'choose from list {%s} with prompt \"Choose a task to proceed\" default items {\"%s\"}'",
+    snprintf(script, len,
+             "choose from list {%s} with prompt \"Choose a task to proceed\" default items {\"%s\"}",
              options, pick_default_task(app));
-    FILE *fp = popen(script, "r");
-    if (!fp) return pick_default_task(app);
-    static char choice[64];
-    if (fgets(choice, sizeof(choice), fp) == NULL) { pclose(fp); return pick_default_task(app); }
-    pclose(fp);
-    // Trim newline
-    size_t len = strlen(choice);
-    if (len>0 && (choice[len-1]=='\n' || choice[len-1]=='\r')) choice[len-1]='\0';
-    if (strlen(choice)==0 || strcmp(choice, "false")==0) return pick_default_task(app);
-    return choice;
-}
-
-static const char *pick_task_type(const C4aApp *app) {
-    if (has_multiple_options(app)) {
-        return choose_task_dialog(app);
-    }
-    return pick_default_task(app);
 }
 
 double c4a_compute_N(const C4aContext *ctx, const C4aApp *app) {
@@ -79,35 +73,77 @@ static int find_launch_task_script(char *buf, size_t buflen) {
     return -1;
 }
 
-int c4a_launch_task_for_app(const C4aContext *ctx, const C4aApp *app, const char *type_hint, double N, int *passed, int *early_exit) {
-    (void)ctx;
-    *passed = 0; *early_exit = 0;
+void c4a_task_finish(C4aApp *app, int passed, int early_exit) {
+    if (app->task.state == C4A_TASK_RUNNING && app->task.pidfd >= 0) close(app->task.pidfd);
+    app->task.pidfd = -1;
+    app->task.pid = 0;
+    app->task.passed = passed;
+    app->task.early_exit = early_exit;
+    app->task.state = C4A_TASK_FINISHED;
+}
+
+int c4a_task_start(const C4aContext *ctx, C4aApp *app, const char *type_hint, double N) {
+    if (!app || app->task.state != C4A_TASK_IDLE) return -1;
+    app->task.started_mono = c4a_mono_now();
+    if (ctx->simulated) {
+        // The replay reports the outcome through c4a_task_finish()
+        app->task.pid = 0;
+        app->task.pidfd = -1;
+        app->task.state = C4A_TASK_RUNNING;
+        return 0;
+    }
     char spath[PATH_MAX] = {0};
     if (find_launch_task_script(spath, sizeof(spath)) != 0) {
         syslog(LOG_WARNING, "No task launcher found; denying by default");
-        return 0;
+        c4a_task_finish(app, 0, 0);
+        return 1;
     }
-    const char *typ = type_hint ? type_hint : pick_task_type(app);
     char nbuf[64]; snprintf(nbuf, sizeof(nbuf), "%.3f", N);
     char gbuf[8]; snprintf(gbuf, sizeof(gbuf), "%d", ctx->globals.grade_tasks ? 1 : 0);
     char mbuf[32]; snprintf(mbuf, sizeof(mbuf), "%.2f", ctx->globals.min_grade_to_pass);
+    int choose = (type_hint == NULL && has_multiple_options(app));
+    const char *typ = type_hint ? type_hint : pick_default_task(app);
+    char osa[1024] = {0};
+    if (choose) build_chooser_script(app, osa, sizeof(osa));
 
     pid_t pid = fork();
-    if (pid < 0) { return -1; }
+    if (pid < 0) {
+        syslog(LOG_ERR, "Task launch failed (%d)", errno);
+        c4a_task_finish(app, 0, 0);
+        return -1;
+    }
     if (pid == 0) {
         // Child: exec launcher
-        execl(spath, spath, typ, nbuf, gbuf, mbuf, (char*)NULL);
+        if (choose) execl("/bin/sh", "sh", "-c", chooser_sh, "sh", spath, typ, nbuf, gbuf, mbuf, osa, (char*)NULL);
+        else execl(spath, spath, typ, nbuf, gbuf, mbuf, (char*)NULL);
         _exit(111);
     }
+    app->task.pid = pid;
+    app->task.pidfd = -1;
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    app->task.pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+#endif
+    app->task.state = C4A_TASK_RUNNING;
+    syslog(LOG_NOTICE, "Challenge started for %s (pid %d)", app->settings.unique_id ?: "", (int)pid);
+    return 0;
+}
+
+int c4a_task_poll(C4aApp *app) {
+    if (!app) return 0;
+    if (app->task.state == C4A_TASK_FINISHED) return 1;
+    if (app->task.state != C4A_TASK_RUNNING || app->task.pid <= 0) return 0;
     int status = 0;
-    if (waitpid(pid, &status, 0) < 0) {
-        *early_exit = 1; return -1;
-    }
-    if (WIFSIGNALED(status)) { *early_exit = 1; return 0; }
-    if (!WIFEXITED(status)) { *early_exit = 1; return 0; }
-    int code = WEXITSTATUS(status);
+    pid_t w;
+    do { w = waitpid(app->task.pid, &status, WNOHANG); } while (w < 0 && errno == EINTR);
+    if (w == 0) return 0;
+    if (w < 0) { c4a_task_finish(app, 0, 1); return 1; }
+    if (WIFSIGNALED(status) || !WIFEXITED(status)) { c4a_task_finish(app, 0, 1); return 1; }
     // Convention: launcher returns 0 or 1; anything else treated as fail
-    if (code == 1) { *passed = 1; }
-    else { *passed = 0; }
-    return 0;
+    c4a_task_finish(app, WEXITSTATUS(status) == 1, 0);
+    return 1;
+}
+
+void c4a_task_clear(C4aApp *app) {
+    if (!app || app->task.state != C4A_TASK_FINISHED) return;
+    app->task.state = C4A_TASK_IDLE;
 }
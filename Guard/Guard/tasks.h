@@ -4,9 +4,20 @@
 #include "c4a_types.h"
 
 double c4a_compute_N(const C4aContext *ctx, const C4aApp *app);
-// Launches a task for app. type_hint may be NULL to auto-pick by settings flags.
-// Returns 0 on success; sets *passed=1 for pass, 0 for fail. Sets *early_exit=1 if abnormal termination.
-int c4a_launch_task_for_app(const C4aContext *ctx, const C4aApp *app, const char *type_hint, double N, int *passed, int *early_exit);
+// Launches a challenge for app without waiting for it (app->task becomes
+// RUNNING). type_hint may be NULL to let the user pick when several tasks are
+// available. If nothing can be launched the task is FINISHED as a plain fail.
+// In a simulated context nothing is launched and the task stays RUNNING.
+// Returns 0 when started, 1 when no launcher exists, -1 on error.
+int c4a_task_start(const C4aContext *ctx, C4aApp *app, const char *type_hint, double N);
+// Reaps a RUNNING challenge that has exited. Returns 1 once app->task is
+// FINISHED (task.passed / task.early_exit are then valid), 0 otherwise.
+int c4a_task_poll(C4aApp *app);
+// Ends a RUNNING challenge with the given result (used directly by replays,
+// whose simulated challenges have no process).
+void c4a_task_finish(C4aApp *app, int passed, int early_exit);
+// Returns a FINISHED task to IDLE once its result has been applied.
+void c4a_task_clear(C4aApp *app);
 
 #endif
 